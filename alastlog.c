@@ -4,31 +4,86 @@
 #include <fcntl.h>
 #include <lastlog.h>
 #include <pwd.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#include "autotune.h"
+#include "containers.h"
+#include "hostmatch.h"
+#include "import.h"
 #include "lllib.h"
-
-char * check_string(char *, int);
+#include "mem.h"
+#include "merge.h"
+#include "mirror.h"
+#include "prof.h"
+#include "progress.h"
+#include "pwfile.h"
+#include "rebuild.h"
+#include "tenant.h"
+#include "trace.h"
+#include "render.h"
+
+void add_row(struct row *, struct passwd *);
 int check_time(struct lastlog *, long);
 struct passwd *extract_user(char *);
 void fatal(char, char *);
+struct passwd *find_name(char *);
+struct passwd *find_uid(uid_t);
+int flush_rows(struct row *, int);
+int gather_rows(struct row *, int, struct passwd **, int);
 int get_log(char *, struct passwd *, long);
-void get_option(char, char **, struct passwd **, long *, char **);
+int get_long_option(char *, char *);
+void get_option(char, char **, char **, long *, char **);
+struct passwd *file_entry(int);
+int keep_row(struct lastlog *, long);
+int lookup_rows(struct row *, int, long);
+struct passwd *next_entry();
+size_t parse_size(char *);
+int parse_threads(char *);
 long parse_time(char *);
-void print_headers();
-int show_info(struct lastlog *, struct passwd *, long, int);
-void show_time(struct lastlog *, char *);
+void prefetch_rows(struct row *, int);
+struct passwd *read_entry(FILE *);
+int run_autotune(char *);
+struct passwd *scan_passwd(char *, uid_t);
+int tune_report(char *, int);
 
 #define LLOG_FILE		"/var/log/lastlog"
-#define TIME_FORMAT		"%a %b %e %H:%M:%S %z %Y"
-#define TIMESIZE		32
+#define PASSWD_FILE		"/etc/passwd"
 #define SECONDS_IN_DAY	86400
+#define ROW_BATCH		1024		//rows per rendering thread per batch
+#define MAX_WTMP		32			//--rebuild-from files
+#define PROGRESS_SECS	1			//--progress report interval
+#define PW_LINE			4096		//longest pw_path line read_entry() keeps
 #define NO 				0
 #define YES 			1
 
+static char *prof_file = NULL;		//--profile output file, NULL if off
+static int threads = 0;				//--threads used to format rows, 0
+									//until set, then from the config
+static int tune = NO;				//--autotune, measure and save config
+static char *tune_file = NULL;		//--tune-file, instead of LL_CONF_FILE
+static char *ct_dir = NULL;			//--containers directory, NULL if off
+static char *mirror_to = NULL;		//--mirror-to copy, NULL if off
+static char *import_from = NULL;	//--import export file, NULL if off
+static char *wtmp_files[MAX_WTMP];	//--rebuild-from files
+static int num_wtmp = 0;			//number of wtmp_files, 0 if off
+static char *merge_list = NULL;		//--merge-from list of host lastlogs
+static char *trace_file = NULL;		//--trace-queries file, NULL if off
+static char *host_file = NULL;		//--host-match-file, NULL if off
+static char *tenant_file = NULL;	//--tenant-map, NULL if off
+static int sinks = NO;				//--sink given, render_sink() called
+static int progress = NO;			//--progress, report every PROGRESS_SECS
+static int no_nss = NO;				//--no-nss, read pw_path directly
+static char *pw_path = PASSWD_FILE;	//--passwd file used with no_nss
+static struct pwlist pw_file;		//pw_path, loaded when no_nss is set
+static int pw_next;					//next pw_file entry for next_entry()
+static FILE *pw_fp = NULL;			//pw_path, read a line at a time when
+									//pw_file does not fit --memory-limit
+
 /*
  * main()
  * Method: Process command-line arguments, if any, and then call get_log()
@@ -40,6 +95,11 @@ void show_time(struct lastlog *, char *);
  *		   If it is not a valid option, fatal() is called and program exits.
  *		   get_option is only called when there is at least one more arg left
  *		   in addition to the '-' option, the (i+1) < ac part in the if case.
+ *		   Long options (--name) are handled by get_long_option(), which
+ *		   reports how many args it used. The -u user is looked up after
+ *		   all options are read, so --profile can include that lookup.
+ *		   --trace-queries is found before the others, so the traced time
+ *		   covers option errors too.
  */
 int main (int ac, char *av[])
 {
@@ -48,44 +108,171 @@ int main (int ac, char *av[])
 
 	//initialize variables to default values, changes with user options
 	struct passwd *user = NULL;
+	char *name = NULL;
 	long days = -1;
 	char *file = NULL;
 
+	signal(SIGUSR1, SIG_IGN);			//until get_log() reports on it
+
+	for (i = 1; i + 1 < ac; i++)		//--trace-queries first: time it all
+		if (strcmp(av[i], "--trace-queries") == 0)
+			trace_file = av[i + 1];
+
+	if (trace_file != NULL && trace_start(trace_file, ac, av) == -1)
+	{
+		perror(trace_file);
+		exit(1);
+	}
+
 	//see Note section above for more on option processing
+	i = 1;
 	while (i < ac)
 	{
-		if(av[i][0] == '-' && (i + 1) < ac)
-			get_option(av[i][1], &av[i + 1], &user, &days, &file);
+		if (av[i][0] == '-' && av[i][1] == '-')
+		{
+			i += get_long_option(&av[i][2], (i + 1) < ac ? av[i + 1] : NULL);
+			continue;
+		}
+		else if(av[i][0] == '-' && (i + 1) < ac)
+			get_option(av[i][1], &av[i + 1], &name, &days, &file);
 		else
 			fatal('\0', av[i]);
 
 		i += 2;				//go past the -X option, and its value
 	}
 
-	//If no file specified with -f, use LLOG_FILE
-	if (file == NULL)
+	if (tune_file != NULL && tune == NO && ll_conf_load(tune_file) == -1)
+	{
+		perror(tune_file);
+		exit(1);
+	}
+
+	if (threads == 0)					//not given: tuned, or 1
+	{
+		struct ll_conf c;
+
+		ll_conf_get(&c);
+		threads = (c.threads > MAX_THREADS) ? MAX_THREADS : c.threads;
+	}
+
+	if (prof_file != NULL && prof_start(prof_file) == -1)
+	{
+		perror(prof_file);
+		exit(1);
+	}
+
+	if (ct_dir != NULL && (name != NULL || file != NULL || sinks == YES ||
+		tenant_file != NULL))
+	{
+		fprintf(stderr, "alastlog: -u, -f, --sink and --tenant-map cannot be "
+				"used with --containers\n");
+		exit(1);
+	}
+
+	if (mem_limit() != 0 && (import_from != NULL || num_wtmp > 0))
+	{
+		fprintf(stderr, "alastlog: --memory-limit cannot be used with "
+				"--import or --rebuild-from\n");
+		exit(1);
+	}
+
+	if (sinks == YES && (mirror_to != NULL || import_from != NULL ||
+		merge_list != NULL || tune == YES || num_wtmp > 0 || tenant_file != NULL))
+	{
+		fprintf(stderr, "alastlog: --sink only writes a lastlog report\n");
+		exit(1);
+	}
+
+	if (progress == YES && (mirror_to != NULL || import_from != NULL ||
+		merge_list != NULL || tune == YES || num_wtmp > 0 || ct_dir != NULL))
+	{
+		fprintf(stderr, "alastlog: --progress only reports on a lastlog "
+				"report\n");
+		exit(1);
+	}
+
+	if (no_nss == YES && pw_load(pw_path, &pw_file) == -1 &&
+		(errno != ENOMEM || (pw_fp = fopen(pw_path, "r")) == NULL))
+	{
+		perror(pw_path);
+		exit(1);
+	}
+
+	if (host_file != NULL && hm_load(host_file) == -1)
+	{
+		perror(host_file);
+		exit(1);
+	}
+
+	if (tenant_file != NULL && tn_load(tenant_file) == -1)
+	{
+		perror(tenant_file);
+		exit(1);
+	}
+
+	prof_enter("extract_user");
+	user = extract_user(name);			//check if valid user/if they exist
+	prof_exit();
+
+	//--containers reads each rootfs's own files; otherwise -f or LLOG_FILE
+	if (mirror_to != NULL)
+		rv = mirror_file(file ? file : LLOG_FILE, mirror_to);
+	else if (import_from != NULL)
+		rv = import_file(import_from, file ? file : LLOG_FILE, find_name,
+						 threads);
+	else if (merge_list != NULL)
+		rv = merge_files(merge_list, file ? file : LLOG_FILE);
+	else if (tune == YES)
+		rv = run_autotune(file ? file : LLOG_FILE);
+	else if (num_wtmp > 0)
+		rv = rebuild_file(wtmp_files, num_wtmp, file ? file : LLOG_FILE,
+						  find_name, threads);
+	else if (ct_dir != NULL)
+		rv = scan_containers(ct_dir, keep_row, days, threads);
+	else if (file == NULL)
 		rv = get_log(LLOG_FILE, user, days);
 	else
 		rv = get_log(file, user, days);
 
+	if (render_finish() == -1)			//summaries, and --sink write errors
+		rv = -1;
+
+	if (mem_limit() != 0)				//--memory-limit: how close it came
+		fprintf(stderr, "alastlog: memory peak %zu of %zu bytes%s\n",
+				mem_peak(), mem_limit(), pw_fp ? ", passwd streamed" : "");
+
+	if (prof_stop() == -1)
+	{
+		perror(prof_file);
+		rv = -1;
+	}
+
+	trace_end(rv);						//no-op without --trace-queries
 	return rv;
 }
 
 /*
- *	check_string()
- *	Purpose: see if the string is null terminated
- *	  Input: a string and the size of the string
- *	 Return: an empty string, if NULL; a null-terminated string
- *			 otherwise (could already be null-terminated when passed in).
+ *	add_row()
+ *	Purpose: copy a passwd entry into a batch row
+ *	  Input: rp, the row to fill in
+ *			 ep, pointer to the user's passwd entry
+ *	   Note: The name is copied, as getpwent() reuses its storage before
+ *			 the batch is rendered. It is freed by lookup_rows() or
+ *			 flush_rows(). The lastlog record is filled in by lookup_rows().
+ *			 With --tenant-map no row is shown, so the name is not copied.
  */
-char * check_string(char *str, int size)
+void add_row(struct row *rp, struct passwd *ep)
 {
-	if (str == NULL)				//if NULL, don't try to access element
-		return "";
-	else if (str[size - 1] != '\0')
-		str[size - 1] = '\0';
+	if (tenant_file != NULL)					//totals only: no names
+		rp->name = NULL;
+	else if ( (rp->name = strdup(ep->pw_name)) == NULL )
+	{
+		perror("alastlog");
+		exit(1);
+	}
 
-	return str;
+	rp->uid = ep->pw_uid;
+	rp->found = NO;
 }
 
 /*
@@ -117,10 +304,10 @@ int check_time(struct lastlog *lp, long days)
  *	Purpose: obtain a passwd struct for a given username/UID
  *	  Input: name, the name/UID that was specified following -u
  *	 Return: a pointer to the passwd struct for the given name/UID.
- *	 Errors: If getpwnam() fails, the function tries to parse the
+ *	 Errors: If find_name() fails, the function tries to parse the
  *			 name into a UID. If it is determined to not be a number,
  *			 an invalid message is output to stderr. If successful,
- *			 but getpwuid() fails, then the "name" specified is
+ *			 but find_uid() fails, then the "name" specified is
  *			 unknown, and we exit.
  */
 struct passwd *extract_user(char *name)
@@ -129,7 +316,7 @@ struct passwd *extract_user(char *name)
 
 	if ( name == NULL)								//no name given, NULL
 		return user;
-	else if ( (user = getpwnam(name)) != NULL)		//name was a username
+	else if ( (user = find_name(name)) != NULL)		//name was a username
 		return user;
 	else											//try name as a UID
 	{
@@ -144,7 +331,7 @@ struct passwd *extract_user(char *name)
 		}
 
 		//We were able to parse out a UID, try getting user with that
-		if ( (user = getpwuid(uid)) == NULL)
+		if ( (user = find_uid(uid)) == NULL)
 		{
 			fprintf(stderr, "alastlog: Unknown user: %s\n", name);
 			exit(1);
@@ -162,62 +349,323 @@ void fatal(char opt, char *arg)
 {
 	if(opt == '\0')
 		fprintf(stderr, "alastlog: unexpected argument: %s\n", arg);
+	else if (opt == '-')
+		fprintf(stderr, "alastlog: unrecognized option '--%s'\n", arg);
 	else
 		fprintf(stderr, "alastlog: invalid option -- '%c'\n", opt);
 
 	fprintf(stderr, "Usage: alastlog [options]\n\nOptions:\n");
 	fprintf(stderr, "\t-u LOGIN\tprint lastlog record for user LOGIN\n");
 	fprintf(stderr, "\t-t DAYS\t\tprint only records more recent than DAYS\n");
-	fprintf(stderr, "\t-f FILE\t\tread data from specified FILE\n\n");
+	fprintf(stderr, "\t-f FILE\t\tread data from specified FILE\n");
+	fprintf(stderr, "\t--profile FILE\twrite folded-stack CPU profile to FILE\n");
+	fprintf(stderr, "\t--threads N\tformat output on N threads\n");
+	fprintf(stderr, "\t--no-nss\tread %s directly, not through NSS\n",
+			PASSWD_FILE);
+	fprintf(stderr, "\t--passwd FILE\tread FILE instead, implies --no-nss\n");
+	fprintf(stderr, "\t--trace-queries FILE\n\t\t\tappend this run's "
+			"arguments and time to FILE\n");
+	fprintf(stderr, "\t--host-match-file FILE\n\t\t\tprint only logins "
+			"from hosts matching a pattern in FILE\n");
+	fprintf(stderr, "\t--sink FORMAT[:PATH]\n\t\t\twrite text, ndjson or "
+			"summary output to PATH (repeatable)\n");
+	fprintf(stderr, "\t--tenant-map FILE\n\t\t\tprint users, active users "
+			"and latest login per tenant\n");
+	fprintf(stderr, "\t--memory-limit SIZE\n\t\t\tkeep buffers and tables "
+			"within SIZE bytes (K, M, G)\n");
+	fprintf(stderr, "\t--progress\treport scan progress to stderr every "
+			"second (and on SIGUSR1)\n");
+	fprintf(stderr, "\t--autotune\ttime window sizes, backends and threads, "
+			"save the best\n");
+	fprintf(stderr, "\t--tune-file FILE\n\t\t\tuse FILE instead of %s\n",
+			LL_CONF_FILE);
+	fprintf(stderr, "\t--containers DIR\n\t\t\treport every container "
+			"rootfs under DIR\n");
+	fprintf(stderr, "\t--mirror-to PATH\n\t\t\tupdate a sparse copy of the "
+			"lastlog at PATH\n");
+	fprintf(stderr, "\t--import FILE\tload CSV or NDJSON login records "
+			"into the lastlog\n");
+	fprintf(stderr, "\t--rebuild-from WTMP\n\t\t\treplace the lastlog with "
+			"the logins in WTMP (repeatable)\n");
+	fprintf(stderr, "\t--merge-from LIST\n\t\t\tmerge the latest logins "
+			"of the lastlogs named in LIST\n\n");
 
 	exit(1);
 }
 
+/*
+ *	file_entry()
+ *	Purpose: present entry i of pw_file as a struct passwd
+ *	 Return: pointer to a static struct, overwritten by the next call, as
+ *			 getpwent() does; only pw_name and pw_uid are filled in
+ */
+struct passwd *file_entry(int i)
+{
+	static struct passwd pw;
+
+	pw.pw_name = pw_file.ents[i].name;
+	pw.pw_uid = pw_file.ents[i].uid;
+
+	return &pw;
+}
+
+/*
+ *	find_name()
+ *	Purpose: look up a username, getpwnam() or, with --no-nss, pw_path
+ *	 Return: the passwd entry, NULL if there is no such user
+ *	 Errors: with --no-nss, exits if pw_path cannot be read
+ */
+struct passwd *find_name(char *name)
+{
+	int i;
+
+	if (no_nss == NO)
+		return getpwnam(name);
+	if (pw_fp != NULL)
+		return scan_passwd(name, 0);
+
+	for (i = 0; i < pw_file.n; i++)
+		if (strcmp(pw_file.ents[i].name, name) == 0)
+			return file_entry(i);
+
+	return NULL;
+}
+
+/*
+ *	find_uid()
+ *	Purpose: look up a UID, getpwuid() or, with --no-nss, pw_path
+ *	 Return: the passwd entry, NULL if there is no such user
+ *	 Errors: as find_name()
+ */
+struct passwd *find_uid(uid_t uid)
+{
+	int i;
+
+	if (no_nss == NO)
+		return getpwuid(uid);
+	if (pw_fp != NULL)
+		return scan_passwd(NULL, uid);
+
+	for (i = 0; i < pw_file.n; i++)
+		if (pw_file.ents[i].uid == uid)
+			return file_entry(i);
+
+	return NULL;
+}
+
+/*
+ *	flush_rows()
+ *	Purpose: render a batch of rows and empty it for reuse
+ *	  Input: rows, the batch
+ *			 n, number of rows in it
+ *	 Return: 0, the new number of rows in the batch
+ */
+int flush_rows(struct row *rows, int n)
+{
+	int i;
+
+	render_rows(rows, n);
+
+	for (i = 0; i < n; i++)
+		free(rows[i].name);
+
+	return 0;
+}
+
+/*
+ *	gather_rows()
+ *	Purpose: fill a batch with the next passwd entries
+ *	  Input: rows, the batch
+ *			 max, room in the batch
+ *			 ep, the next entry, advanced past the ones used
+ *			 single, the entry is a -u user, so there is no next one
+ *	 Return: number of rows filled, 0 once the entries run out
+ */
+int gather_rows(struct row *rows, int max, struct passwd **ep, int single)
+{
+	int n = 0;
+
+	while (n < max && *ep != NULL)
+	{
+		add_row(&rows[n++], *ep);
+		*ep = single ? NULL : next_entry();
+	}
+
+	return n;
+}
+
 /*
  *	get_log()
  *	Purpose: Print out lastlog records, filtered as appropriate by user options
  *	  Input: file, lastlog to read from (LLOG_FILE by default)
  *			 user, specific username/UID to display record for
  *			 days, restrict output to logins within given number of days
- *	 Output: formatted headers and entries, through calling show_info
+ *	 Output: formatted headers and entries, through calling render_rows
+ *	 Method: passwd entries are taken a batch (ROW_BATCH rows per thread)
+ *			 at a time. Before a batch is used, the next one is gathered and
+ *			 its lastlog windows handed to ll_prefetch(), so the disk reads
+ *			 ahead while this batch is looked up, filtered by -t, and given
+ *			 to render_rows(), which formats it on --threads threads and
+ *			 writes it out in passwd order. SIGUSR1, or --progress, writes
+ *			 progress lines to stderr meanwhile. Under --memory-limit the
+ *			 batch is halved until two of them and their formatted text fit
+ *			 in what is left; the output is the same, in more batches.
  *	 Errors: If there was a problem opening the lastlog file (ll_open) or
  *			 a problem extracting a provided user (extract_user), the program
  *			 will print a message to stderr and exit.
  */
 int get_log(char *file, struct passwd *user, long days)
 {
+	int rv;
+
+	prof_enter("get_log");
+
 	if (ll_open(file) == -1)					//open lastlog file
 	{
 		perror(file);
 		exit(1);
 	}
 
+	if (render_init(threads) == -1)				//opens the --sink files
+		exit(1);
+
 	struct passwd *entry = user;				//store passwd record
-	struct lastlog *ll;							//store lastlog record
-	int headers = NO;							//have headers been printed
+	int batch = ROW_BATCH * threads;			//rows rendered at a time
+	size_t per_row = 2 * sizeof(struct row) + render_row_bytes();
+
+	while (batch > 1 && batch * per_row > mem_avail())
+		batch /= 2;								//--memory-limit: fewer rows
+
+	if (batch * per_row > mem_avail())
+	{
+		fprintf(stderr, "alastlog: --memory-limit is too small\n");
+		exit(1);
+	}
+
+	struct row *cur = mem_alloc(batch * sizeof(struct row));
+	struct row *next = mem_alloc(batch * sizeof(struct row));
+	struct row *swap;
+	int n, m;									//rows in cur and next
+
+	if (cur == NULL || next == NULL)
+	{
+		perror("alastlog");
+		exit(1);
+	}
+
+	//SIGUSR1 reports always; --progress also every PROGRESS_SECS seconds
+	if (progress_start(progress ? PROGRESS_SECS : 0,
+					   user ? 1 : (no_nss ? pw_file.n : 0)) == -1)
+	{
+		perror("alastlog");
+		exit(1);
+	}
 
 	if(entry == NULL)							//if -u user was not specified
-		entry = getpwent();						//open passwd db to iterate
+		entry = next_entry();					//open passwd db to iterate
 
-	while (entry)								//still have a passwd entry
+	n = gather_rows(cur, batch, &entry, user != NULL);
+	prefetch_rows(cur, n);
+
+	while (n > 0)								//still have passwd entries
 	{
-		if ( ll_seek(entry->pw_uid) == -1 )		//get the correct pos in buffer
-			ll = NULL;							//error
-		else
-			ll = ll_read();						//okay to read
+		m = gather_rows(next, batch, &entry, user != NULL);
+		prefetch_rows(next, m);					//disk reads ahead on next...
 
-		headers = show_info(ll, entry, days, headers);
+		n = lookup_rows(cur, n, days);			//...while cur is read and
+		flush_rows(cur, n);						//formatted
 
-		if( user != NULL)						//a user specified with -u
-			break;								//found them, so break
-		else
-			entry = getpwent();					//go until end of passwd db
+		swap = cur;
+		cur = next;
+		next = swap;
+		n = m;
 	}
 
-	if(user == NULL)							//if user not specified
+	mem_free(cur);
+	mem_free(next);
+	progress_stop();
+
+	if(user == NULL && no_nss == NO)			//if user not specified
 		endpwent();								//close link to passwd database
 
-	return ll_close();							//close lastlog file, -1 if err
+	if (tenant_file != NULL)
+		tn_report(find_uid);
+
+	rv = ll_close();							//close lastlog file, -1 if err
+	prof_exit();
+
+	return rv;
+}
+
+/*
+ *	get_long_option()
+ *	Purpose: process a --name command line option
+ *	  Input: name, the option text following the "--"
+ *			 val, the arg following the option, or NULL if there is none
+ *	 Return: the number of args used, 2 for "--name value", 1 for a flag
+ *	 Errors: An unknown name, or a missing value, calls fatal() to print a
+ *			 message and usage to stderr and exit.
+ */
+int get_long_option(char *name, char *val)
+{
+	if (strcmp(name, "no-nss") == 0)
+	{
+		no_nss = YES;					//main() loads pw_path
+		return 1;
+	}
+	else if (strcmp(name, "autotune") == 0)
+	{
+		tune = YES;						//saves to tune_file or LL_CONF_FILE
+		return 1;
+	}
+	else if (strcmp(name, "progress") == 0)
+	{
+		progress = YES;					//get_log() reports to stderr
+		return 1;
+	}
+	else if (strcmp(name, "profile") == 0 && val != NULL)
+		prof_file = val;				//prof_start() will open it
+	else if (strcmp(name, "trace-queries") == 0 && val != NULL)
+		trace_file = val;				//main() already started the trace
+	else if (strcmp(name, "host-match-file") == 0 && val != NULL)
+		host_file = val;				//main() loads the patterns
+	else if (strcmp(name, "memory-limit") == 0 && val != NULL)
+		mem_set_limit(parse_size(val));	//exits if not a size
+	else if (strcmp(name, "tenant-map") == 0 && val != NULL)
+		tenant_file = val;				//main() loads the ranges
+	else if (strcmp(name, "sink") == 0 && val != NULL)
+	{
+		if (render_sink(val) == -1)		//render_init() opens the file
+		{
+			perror(val);
+			exit(1);
+		}
+		sinks = YES;
+	}
+	else if (strcmp(name, "tune-file") == 0 && val != NULL)
+		tune_file = val;				//read at start, or --autotune output
+	else if (strcmp(name, "passwd") == 0 && val != NULL)
+	{
+		pw_path = val;					//implies --no-nss
+		no_nss = YES;
+	}
+	else if (strcmp(name, "threads") == 0 && val != NULL)
+		threads = parse_threads(val);	//exits if not 1..MAX_THREADS
+	else if (strcmp(name, "containers") == 0 && val != NULL)
+		ct_dir = val;					//scan_containers() checks it
+	else if (strcmp(name, "mirror-to") == 0 && val != NULL)
+		mirror_to = val;				//copy -f FILE there, no report
+	else if (strcmp(name, "import") == 0 && val != NULL)
+		import_from = val;				//write into -f FILE, no report
+	else if (strcmp(name, "rebuild-from") == 0 && val != NULL &&
+			 num_wtmp < MAX_WTMP)
+		wtmp_files[num_wtmp++] = val;	//may be given more than once
+	else if (strcmp(name, "merge-from") == 0 && val != NULL)
+		merge_list = val;				//write into -f FILE, no report
+	else
+		fatal('-', name);				//unrecognized option, exit with error
+
+	return 2;
 }
 
 /*
@@ -225,24 +673,23 @@ int get_log(char *file, struct passwd *user, long days)
  *	Purpose: process command line options
  *	  Input: opt, the char following the '-' flag
  *			 value, the argument following the [-utf] flag
- *			 user, pointer to store specified user
+ *			 name, pointer to store specified username/UID
  *			 days, pointer to store specified time restriction
  *			 file, pointer to store specified file
  *	 Return: None. This function passes through pointers from main
  *			 to store the variables.
- *	 Errors: For the -u and -t options, parsing functions are called to
- *			 determine if the input is valid. extract_user() obtains the
- *			 passwd entry, or exits if not found/invalid. parse_time()
- *			 changes the text input into a number, or exits if not valid.
+ *	 Errors: For the -t option, parse_time() changes the text input into a
+ *			 number, or exits if not valid. The -u name is checked later by
+ *			 main(), through extract_user(), once all options are read.
  *	  Notes: If there is an invalid option (not -utf), fatal is called
  *			 to output a message to stderr and exit with a non-zero status.
  *			 See also, errors above for invalid input.
  */
 void
-get_option(char opt, char **val, struct passwd **user, long *days, char **file)
+get_option(char opt, char **val, char **name, long *days, char **file)
 {
 	if(opt == 'u')
-		*user = extract_user(*val);		//check if valid user/if they exist
+		*name = *val;					//main will call extract_user()
 	else if (opt == 't')
 		*days = parse_time(*val);		//check if valid time, exit if not
 	else if (opt == 'f')
@@ -253,6 +700,182 @@ get_option(char opt, char **val, struct passwd **user, long *days, char **file)
 	return;
 }
 
+/*
+ *	keep_row()
+ *	Purpose: apply the row filters to a lastlog record
+ *	  Input: lp, the record, NULL if there is none
+ *			 days, the -t argument, -1 if not given
+ *	 Return: YES if the row is shown: it passes check_time() and, with
+ *			 --host-match-file, its ll_host matches one of the patterns
+ */
+int keep_row(struct lastlog *lp, long days)
+{
+	struct ll_field host;
+
+	if (check_time(lp, days) == NO)
+		return NO;
+	if (host_file == NULL)
+		return YES;
+	if (lp == NULL)
+		return NO;
+
+	host = ll_field(lp->ll_host, UT_HOSTSIZE);
+	return hm_match(host.str, host.len) ? YES : NO;
+}
+
+/*
+ *	lookup_rows()
+ *	Purpose: read the lastlog record of each row in a batch, and drop the
+ *			 rows keep_row() rejects
+ *	  Input: rows, the batch
+ *			 n, number of rows in it
+ *			 days, restrict output to logins within given number of days
+ *	 Return: number of rows kept, moved to the front of the batch in order
+ */
+int lookup_rows(struct row *rows, int n, long days)
+{
+	struct lastlog *ll;							//store lastlog record
+	int i, kept = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		if ( ll_seek(rows[i].uid) == -1 )		//get the correct pos in buffer
+			ll = NULL;							//error
+		else
+			ll = ll_read();						//okay to read
+
+		if (tenant_file != NULL)				//count it, show no rows
+		{
+			tn_add(tn_find(rows[i].uid), rows[i].uid, ll,
+				   keep_row(ll, days));
+			continue;
+		}
+
+		//filter on -t time in days and --host-match-file
+		if (keep_row(ll, days) == NO)
+		{
+			free(rows[i].name);
+			continue;
+		}
+
+		rows[kept] = rows[i];
+		rows[kept].found = (ll != NULL);
+		if (ll)
+			rows[kept].ll = *ll;				//ll_read() reuses its buffer
+		kept++;
+	}
+
+	return kept;
+}
+
+/*
+ *	next_entry()
+ *	Purpose: getpwent() wrapped in a profiler span, so time spent in the
+ *			 passwd database (NSS modules) shows up as its own frame
+ *	 Return: the next passwd entry, NULL at the end of the database
+ *	   Note: with --no-nss, the next entry of pw_path instead, from
+ *			 pw_file or, if it did not fit, read from pw_fp
+ */
+struct passwd *next_entry()
+{
+	struct passwd *entry;
+
+	if (no_nss == YES && pw_fp != NULL)
+		return read_entry(pw_fp);
+	if (no_nss == YES)
+		return (pw_next < pw_file.n) ? file_entry(pw_next++) : NULL;
+
+	prof_enter("getpwent");
+	entry = getpwent();
+	prof_exit();
+
+	return entry;
+}
+
+/*
+ *	prefetch_rows()
+ *	Purpose: ask for the lastlog records of a batch to be read ahead
+ *	  Input: rows, the batch
+ *			 n, number of rows in it
+ */
+void prefetch_rows(struct row *rows, int n)
+{
+	static int *recs = NULL;					//UIDs, scratch for ll_prefetch
+	static int cap = 0;
+	int i;
+
+	if (n > cap)
+	{
+		mem_free(recs);
+		if ( (recs = mem_alloc(n * sizeof(int))) == NULL )
+		{
+			cap = 0;
+			return;								//only a hint, skip it
+		}
+		cap = n;
+	}
+
+	for (i = 0; i < n; i++)
+		recs[i] = rows[i].uid;
+
+	ll_prefetch(recs, n);
+}
+
+/*
+ *	parse_size()
+ *	Purpose: translate a --memory-limit value into bytes
+ *	  Input: value, a number of bytes, or of K, M or G (1024-based) units
+ *	 Return: the size, at least 1
+ *	 Errors: if the value is not such a size, print a message to stderr and
+ *			 exit
+ */
+size_t parse_size(char *value)
+{
+	char *temp = NULL;
+	unsigned long long size = strtoull(value, &temp, 10);
+	int shift = 0;
+
+	if (*temp == 'K' || *temp == 'k')
+		shift = 10;
+	else if (*temp == 'M' || *temp == 'm')
+		shift = 20;
+	else if (*temp == 'G' || *temp == 'g')
+		shift = 30;
+	if (shift > 0)
+		temp++;
+
+	if (temp == value || *temp != '\0' || value[0] == '-' || size == 0 ||
+		size > (SIZE_MAX >> shift))
+	{
+		fprintf(stderr, "alastlog: invalid memory limit '%s'\n", value);
+		exit(1);
+	}
+
+	return (size_t) size << shift;
+}
+
+/*
+ *	parse_threads()
+ *	Purpose: translate a --threads value into a thread count
+ *	  Input: value, the text the user entered
+ *	 Return: the count, from 1 to MAX_THREADS
+ *	 Errors: if the value is not a number in that range, print a message to
+ *			 stderr and exit
+ */
+int parse_threads(char *value)
+{
+	char *temp = NULL;
+	long count = strtol(value, &temp, 10);
+
+	if (*temp != '\0' || count < 1 || count > MAX_THREADS)
+	{
+		fprintf(stderr, "alastlog: invalid thread count '%s'\n", value);
+		exit(1);
+	}
+
+	return count;
+}
+
 /*
  *	parse_time()
  *	Purpose: translate a DAY value into a corresponding time value
@@ -276,91 +899,112 @@ long parse_time(char *value)
 }
 
 /*
- *	print_headers() - output formatted lastlog headers
+ *	read_entry()
+ *	Purpose: read the next usable entry of a passwd file as a struct passwd
+ *	 Return: pointer to a static struct, as file_entry(); NULL at the end
+ *			 of the file
  */
-void print_headers()
+struct passwd *read_entry(FILE *fp)
 {
-	printf("%-16.16s ", "Username");
-	printf("%-8.8s ", "Port");
-	printf("%-16.16s ", "From");
-	printf("%s", "Latest");
-	printf("\n");
+	static char line[PW_LINE];
+	static struct passwd pw;
+	struct pwent pe;
 
-	return;
+	if (!pw_read(fp, &pe, line, PW_LINE))
+		return NULL;
+
+	pw.pw_name = pe.name;
+	pw.pw_uid = pe.uid;
+
+	return &pw;
 }
 
 /*
- *	show_info()
- *	Purpose: display information in lastlog record, with potential time filter
- *	  Input: lp, pointer to the lastlog record
- *			 ep, pointer to the user's passwd entry
- *			 days, entered with -t option (-1 if none); used to filter results
- *			 headers, used to determine if we should print headers
- *	 Output: fixed-width formatted columns for username, line, host, and time
- *	 Return: YES, if an entry was printed to output
- *			 headers, the current state of headers (either YES or NO). If a -t
- *			 	option is specified, show_info may be called multiple times
- *			 	without displaying output. If no users match the -t
- *				restriction, no users are displayed and neither should
- *				headers.
- *	   Note: For cases where the *lp is NULL, blank strings are printed as
- *			 trying to access the members of the struct (i.e. lp->ll_line)
- *			 would cause a seg fault.
+ *	run_autotune()
+ *	Purpose: --autotune, find and save the fastest settings for a lastlog
+ *	  Input: file, the lastlog to measure with
+ *	 Return: as autotune()
+ *	 Method: The UIDs are listed once, in passwd order, for the lookup
+ *			 timings; tune_report() runs whole reports for the thread ones,
+ *			 with the sinks paused so --sink files do not collect them.
  */
-int show_info(struct lastlog *lp, struct passwd *ep, long days, int headers)
+int run_autotune(char *file)
 {
-	//filter based on user-provided time in days, don't print if outside range
-	if (check_time(lp, days) == NO)
-		return headers;
-
-	//check if we have already printed headers
-	if (headers == NO)
-		print_headers();
+	struct passwd *ep;
+	int *uids = NULL;
+	int n = 0, cap = 0, rv;
 
-	printf("%-16.16s ", ep->pw_name);		//print username
-
-	if (lp)									//if exists, print lastlog info
+	while ( (ep = next_entry()) != NULL )
 	{
-		printf("%-8.8s ", check_string(lp->ll_line, UT_LINESIZE));
-		printf("%-16.16s ", check_string(lp->ll_host, UT_HOSTSIZE));
-	}
-	else									//would seg-fault, print blanks
-	{
-		printf("%-8.8s ", "");
-		printf("%-16.16s ", "");
+		if (n == cap)
+		{
+			cap = 2 * cap + 256;
+			if ( (uids = mem_realloc(uids, cap * sizeof(int))) == NULL )
+			{
+				perror("alastlog");
+				exit(1);
+			}
+		}
+		uids[n++] = ep->pw_uid;
 	}
 
-	show_time(lp, TIME_FORMAT);				//display time, or never logged in
-	printf("\n");							//end of record, add newline
+	if (no_nss == NO)
+		endpwent();
+	if (pw_fp != NULL)
+		rewind(pw_fp);
 
-	return YES;
+	render_pause(YES);					//timing runs only, no output
+	rv = autotune(file, tune_file ? tune_file : LL_CONF_FILE, uids, n,
+				  tune_report);
+	render_pause(NO);
+	mem_free(uids);
+
+	return rv;
 }
 
 /*
- *	show_time()
- *	Purpose: format a time and print it
- *	  Input: lp, pointer to the lastlog record
- *			 fmt, the format to print the time in
- *	 Output: If the lastlog record is null, or the time is 0, the user
- *			 does not exist or has never logged on, so display that. Otherwise,
- *			 get the time, lp->ll_time, and format it according to "fmt".
- *	  Notes: copied, with slight modifications, from the who2.c code from
- *			 lecture #2.
+ *	scan_passwd()
+ *	Purpose: find_name() and find_uid() for a pw_path too big to load
+ *	  Input: name, the username to find, or NULL to find uid instead
+ *	 Return: the first matching entry, NULL if there is none
+ *	 Method: Reads pw_path from the top on a stream of its own, so a scan
+ *			 going through pw_fp keeps its place; a lookup costs a pass
+ *			 over the file instead of memory.
+ *	 Errors: exits if pw_path cannot be opened
  */
-void show_time(struct lastlog *lp, char *fmt)
+struct passwd *scan_passwd(char *name, uid_t uid)
 {
-	if (lp == NULL || lp->ll_time == 0)		//user doesn't exist/no login
+	FILE *fp = fopen(pw_path, "r");
+	struct passwd *ep;
+
+	if (fp == NULL)
 	{
-		printf("**Never logged in**");
+		perror(pw_path);
+		exit(1);
 	}
-	else									//parse the time into TIME_FORMAT
-	{
-		char result[TIMESIZE];
-		time_t time = lp->ll_time;
-		strftime(result, TIMESIZE, fmt, localtime(&time));
 
-		printf("%s", result);
-	}
+	while ( (ep = read_entry(fp)) != NULL &&
+			(name ? strcmp(ep->pw_name, name) != 0 : ep->pw_uid != uid) )
+		;
 
-	return;
+	fclose(fp);
+
+	return ep;
+}
+
+/*
+ *	tune_report()
+ *	Purpose: one full report for autotune() to time
+ *	  Input: file, the lastlog
+ *			 t, number of threads to format on
+ *	 Return: as get_log()
+ */
+int tune_report(char *file, int t)
+{
+	threads = t;
+	pw_next = 0;						//start --no-nss entries over
+	if (pw_fp != NULL)
+		rewind(pw_fp);
+
+	return get_log(file, NULL, -1);
 }
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "autotune.h"
+#include "lllib.h"
+#include "prof.h"
+#include "render.h"
+
+#define TUNE_REPS		5			//runs of each setting, the best counts
+#define TUNE_SLACK		1.05		//a change must win by 5% to be chosen
+#define NS_IN_SEC		1000000000L
+
+static const int windows[] = { 16, 64, 256, 512, 2048, 8192, 0 };
+
+long now_ns();
+long time_lookups(char *, const int *, int);
+long time_report(char *, int (*)(char *, int), int);
+
+/*
+ *	autotune()
+ *	Purpose: find the fastest way to read a lastlog on this host, and save it
+ *			 for llf_open() to use
+ *	  Input: file, the lastlog to measure with
+ *			 conf_path, where to save the result
+ *			 uids, n, the passwd UIDs, in passwd order
+ *			 report, runs a whole report on the given number of threads
+ *	 Output: a table of timings, then the chosen settings
+ *	 Return: 0 on success, -1 if the file cannot be read or the result
+ *			 cannot be saved (a message is printed to stderr)
+ *	 Method: First each backend and window is timed on the lookups a report
+ *			 makes: open, then a seek and read for every UID in passwd
+ *			 order. Then, with the fastest of those, whole reports (output
+ *			 to /dev/null) are timed on 1, 2, 4, ... threads, up to the
+ *			 number of CPUs. Each is run TUNE_REPS times and the best run
+ *			 counts. The current setting, and then the smaller thread count,
+ *			 is kept unless the other is TUNE_SLACK faster, so noise does not
+ *			 flip the result between runs.
+ *	   Note: The page cache is warm after the first run, so this tunes the
+ *			 CPU and system call cost of a report, which is what most runs
+ *			 pay; it does not measure cold disk reads.
+ */
+int autotune(char *file, char *conf_path, const int *uids, int n,
+			 int (*report)(char *, int))
+{
+	struct ll_conf best, c;
+	long best_ns = -1, ns;
+	int b, w, t, cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	prof_enter("autotune");
+	ll_conf_get(&best);
+	c = best;
+
+	printf("autotune: %s, %d users\n", file, n);
+	printf("  %-8s %8s %12s\n", "backend", "window", "lookups");
+
+	if ( (best_ns = time_lookups(file, uids, n)) == -1 )	//as configured
+	{
+		perror(file);
+		prof_exit();
+		return -1;
+	}
+
+	for (b = 0; b < LL_BACKENDS; b++)
+		for (w = 0; windows[w] != 0; w++)
+		{
+			c.backend = b;
+			c.window = windows[w];
+			ll_conf_set(&c);
+
+			if ( (ns = time_lookups(file, uids, n)) == -1 )
+			{
+				perror(file);
+				prof_exit();
+				return -1;
+			}
+
+			printf("  %-8s %8d %10.1fus\n", ll_backend_name(b), windows[w],
+				   ns / 1e3);
+			if (ns * TUNE_SLACK < best_ns)
+			{
+				best = c;
+				best_ns = ns;
+			}
+		}
+
+	ll_conf_set(&best);
+	best_ns = -1;
+	if (cpus > MAX_THREADS)
+		cpus = MAX_THREADS;
+
+	for (t = 1; t == 1 || t <= cpus; t *= 2)
+	{
+		ns = time_report(file, report, t);
+		printf("  threads %-3d %17.1fus\n", t, ns / 1e3);
+		if (best_ns == -1 || ns * TUNE_SLACK < best_ns)
+		{
+			best.threads = t;
+			best_ns = ns;
+		}
+	}
+
+	prof_exit();
+
+	if (ll_conf_save(conf_path, &best) == -1)
+	{
+		perror(conf_path);
+		return -1;
+	}
+
+	printf("autotune: window %d, backend %s, threads %d saved to %s\n",
+		   best.window, ll_backend_name(best.backend), best.threads,
+		   conf_path);
+
+	return 0;
+}
+
+/*
+ *	now_ns() - monotonic clock reading, in nanoseconds
+ */
+long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/*
+ *	time_lookups()
+ *	Purpose: time the lastlog side of a report with the current settings
+ *	 Return: best of TUNE_REPS runs in nanoseconds, -1 if file cannot be
+ *			 opened
+ *	   Note: Each record is copied out, as lookup_rows() does; with LL_MMAP
+ *			 llf_read() only computes a pointer, and the page is touched
+ *			 (and faulted in) by the copy.
+ */
+long time_lookups(char *file, const int *uids, int n)
+{
+	static volatile long seen;			//keeps the copies from being dropped
+	struct lastlog rec, *lp;
+	long best = -1;
+	int r, i;
+
+	for (r = 0; r < TUNE_REPS; r++)
+	{
+		long t0 = now_ns(), ns;
+		struct llfile *lf = llf_open(file);
+
+		if (lf == NULL)
+			return -1;
+
+		for (i = 0; i < n; i++)
+			if (llf_seek(lf, uids[i]) == 0 && (lp = llf_read(lf)) != NULL)
+			{
+				rec = *lp;
+				seen += rec.ll_time;
+			}
+
+		llf_close(lf);
+		ns = now_ns() - t0;
+		if (best == -1 || ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+/*
+ *	time_report()
+ *	Purpose: time whole reports on a number of threads, output discarded
+ *	 Return: best of TUNE_REPS runs in nanoseconds
+ *	 Method: stdout is pointed at /dev/null around the runs; stdio is
+ *			 flushed first, so the table printed so far is not lost.
+ */
+long time_report(char *file, int (*report)(char *, int), int threads)
+{
+	int null = open("/dev/null", O_WRONLY);
+	int saved = dup(STDOUT_FILENO);
+	long best = -1;
+	int r;
+
+	fflush(stdout);
+	if (null != -1)
+		dup2(null, STDOUT_FILENO);
+
+	for (r = 0; r < TUNE_REPS; r++)
+	{
+		long t0 = now_ns(), ns;
+
+		report(file, threads);
+		ns = now_ns() - t0;
+		if (best == -1 || ns < best)
+			best = ns;
+	}
+
+	if (saved != -1)
+	{
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+	}
+	if (null != -1)
+		close(null);
+
+	return best;
+}
@@ -0,0 +1,5 @@
+/*
+ * autotune.h - header file with functions located in autotune.c
+ */
+
+int autotune(char *, char *, const int *, int, int (*)(char *, int));
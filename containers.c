@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "containers.h"
+#include "lllib.h"
+#include "pwfile.h"
+#include "render.h"
+#include "prof.h"
+
+#define CT_LASTLOG		"/var/log/lastlog"	//lastlog inside a rootfs
+#define CT_PASSWD		"/etc/passwd"		//passwd inside a rootfs
+#define CT_MAP_SUFFIX	".uid_map"			//DIR/NAME.uid_map, next to rootfs
+#define CT_MAX_MAP		340					//ranges per map, as the kernel
+#define CT_PREFIX		28					//"Container" and "UID" columns
+#define CT_PW_LINE		4096				//longest passwd line kept, streamed
+#define OVERFLOW_UID	65534				//unmapped UIDs, as the kernel
+
+/*
+ * idrange - one line of a uid_map: count UIDs starting at inside in the
+ * container are outside, outside+1, ... on the host
+ */
+struct idrange {
+	unsigned long inside;
+	unsigned long outside;
+	unsigned long count;
+};
+
+/*
+ * box - one container: where it is, and its formatted output once scanned
+ */
+struct box {
+	char *name;						//directory name, used as the label
+	char *buf;						//formatted rows
+	size_t len;						//bytes of text in buf
+	size_t cap;						//bytes allocated for buf
+	int failed;						//lastlog or passwd could not be read
+	int done;						//buf is complete
+};
+
+static char *ct_dir;				//directory holding the rootfs dirs
+static struct box *boxes;			//one per rootfs, in name order
+static int num_boxes;				//number of boxes
+static int next_box;				//next box for a worker to take
+static int (*ct_keep)(struct lastlog *, long);	//row filter, e.g. -t
+static long ct_days;				//argument for ct_keep
+static pthread_mutex_t ct_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ct_done = PTHREAD_COND_INITIALIZER;
+
+int find_boxes();
+int grow_box(struct box *, int);
+int is_rootfs(const struct dirent *);
+int load_map(char *, struct idrange *);
+unsigned long map_uid(struct idrange *, int, unsigned long);
+int next_pwent(struct pwlist *, int, FILE *, struct pwent *, char *);
+void scan_box(struct box *);
+void *scan_worker(void *);
+
+/*
+ *	scan_containers()
+ *	Purpose: print the lastlog of every container rootfs under a directory
+ *			 as one stream, each row labeled with its container
+ *	  Input: dir, directory whose subdirectories are container rootfs trees,
+ *				each with its own var/log/lastlog and etc/passwd
+ *			 keep, filter called for each record, as check_time()
+ *			 days, passed through to keep
+ *			 threads, number of containers scanned at the same time
+ *	 Output: headers, then for each container, in name order, a row per
+ *			 entry of its own passwd: container name, host UID, then the
+ *			 usual Username, Port, From and Latest columns
+ *	 Return: 0 on success, -1 if any container could not be scanned or
+ *			 writing to stdout failed (the error is printed to stderr)
+ *	 Method: Worker threads take containers off a shared counter and
+ *			 format each into its own buffer with lllib llf_ handles, so the
+ *			 scans overlap. This thread writes the buffers out in order,
+ *			 each as soon as it and all before it are done.
+ */
+int scan_containers(char *dir, int (*keep)(struct lastlog *, long), long days,
+					int threads)
+{
+	pthread_t tids[MAX_THREADS];
+	int started = 0, failed = 0, headers = 0, werr = 0;
+	int i;
+
+	ct_dir = dir;
+	ct_keep = keep;
+	ct_days = days;
+
+	prof_enter("scan_containers");
+
+	if (find_boxes() == -1)
+	{
+		perror(dir);
+		exit(1);
+	}
+
+	for (i = 0; i < threads && i < num_boxes; i++)
+		if (pthread_create(&tids[started], NULL, scan_worker, NULL) == 0)
+			started++;
+
+	if (started == 0)						//no threads, do it all here
+		scan_worker(NULL);
+
+	for (i = 0; i < num_boxes; i++)			//write out in order
+	{
+		struct box *bp = &boxes[i];
+
+		pthread_mutex_lock(&ct_lock);
+		while (!bp->done)
+			pthread_cond_wait(&ct_done, &ct_lock);
+		pthread_mutex_unlock(&ct_lock);
+
+		if (bp->len > 0 && !headers)
+		{
+			char head[ROW_MAX + CT_PREFIX];
+			int len = sprintf(head, "%-16.16s %-10.10s ", "Container", "UID");
+
+			len += format_headers(head + len);
+			if (write_all(head, len) == -1 && werr == 0)
+				werr = errno;
+			headers = 1;
+		}
+
+		if (write_all(bp->buf, bp->len) == -1 && werr == 0)
+			werr = errno;
+		failed |= bp->failed;
+		free(bp->buf);
+		free(bp->name);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	free(boxes);
+	prof_exit();
+
+	if (werr != 0)							//report the first write error
+	{
+		errno = werr;
+		perror("stdout");
+		failed = 1;
+	}
+
+	return failed ? -1 : 0;
+}
+
+/*
+ *	find_boxes()
+ *	Purpose: list the subdirectories of ct_dir that hold a lastlog
+ *	 Return: 0 on success, -1 if ct_dir cannot be read (errno is set)
+ *	 Method: scandir() with alphasort, so output order is stable from run
+ *			 to run. Entries without a var/log/lastlog, such as uid_map
+ *			 files, are left out by is_rootfs().
+ */
+int find_boxes()
+{
+	struct dirent **list;
+	int i;
+
+	if ( (num_boxes = scandir(ct_dir, &list, is_rootfs, alphasort)) == -1 )
+		return -1;
+
+	if ( (boxes = calloc(num_boxes + 1, sizeof(struct box))) == NULL )
+		return -1;
+
+	for (i = 0; i < num_boxes; i++)
+	{
+		if ( (boxes[i].name = strdup(list[i]->d_name)) == NULL )
+			return -1;
+		free(list[i]);
+	}
+
+	free(list);
+	next_box = 0;
+
+	return 0;
+}
+
+/*
+ *	grow_box()
+ *	Purpose: count len more bytes of a box's output, and make room for more
+ *	 Return: 0 on success, -1 if memory ran out
+ *	   Note: The caller has already formatted the text at bp->buf + bp->len,
+ *			 which must have ROW_MAX + CT_PREFIX bytes free; this leaves at
+ *			 least that much free again for the next row.
+ */
+int grow_box(struct box *bp, int len)
+{
+	bp->len += len;
+
+	if (bp->cap - bp->len < ROW_MAX + CT_PREFIX)
+	{
+		char *bigger = realloc(bp->buf, 2 * bp->cap);
+
+		if (bigger == NULL)
+			return -1;
+
+		bp->buf = bigger;
+		bp->cap *= 2;
+	}
+
+	return 0;
+}
+
+/*
+ *	is_rootfs()
+ *	Purpose: scandir() filter, keep entries that have a var/log/lastlog
+ */
+int is_rootfs(const struct dirent *dp)
+{
+	char path[PATH_MAX];
+
+	if (dp->d_name[0] == '.')
+		return 0;
+
+	snprintf(path, PATH_MAX, "%s/%s%s", ct_dir, dp->d_name, CT_LASTLOG);
+	return access(path, F_OK) == 0;
+}
+
+/*
+ *	load_map()
+ *	Purpose: read a container's UID map, if it has one
+ *	  Input: path, a file in the format of /proc/PID/uid_map, i.e. lines of
+ *				"inside outside count"
+ *			 map, room for CT_MAX_MAP ranges
+ *	 Return: number of ranges; -1 if there is no map file, meaning the
+ *			 container shares the host's UIDs
+ */
+int load_map(char *path, struct idrange *map)
+{
+	FILE *fp = fopen(path, "r");
+	int n = 0;
+
+	if (fp == NULL)
+		return -1;
+
+	while (n < CT_MAX_MAP && fscanf(fp, "%lu %lu %lu", &map[n].inside,
+									&map[n].outside, &map[n].count) == 3)
+		n++;
+
+	fclose(fp);
+	return n;
+}
+
+/*
+ *	map_uid()
+ *	Purpose: translate a UID inside a container to the host UID
+ *	  Input: map, the container's ranges, n of them (-1 for no map)
+ *			 uid, the UID inside the container
+ *	 Return: the host UID, or OVERFLOW_UID if uid is in no range
+ */
+unsigned long map_uid(struct idrange *map, int n, unsigned long uid)
+{
+	int i;
+
+	if (n == -1)
+		return uid;
+
+	for (i = 0; i < n; i++)
+		if (uid >= map[i].inside && uid - map[i].inside < map[i].count)
+			return map[i].outside + (uid - map[i].inside);
+
+	return OVERFLOW_UID;
+}
+
+/*
+ *	next_pwent()
+ *	Purpose: get the next entry of a container's passwd file
+ *	  Input: pl, the file as pw_load() read it, used if fp is NULL
+ *			 i, the number of pl's entries already used
+ *			 fp, the file opened instead, if it did not fit the budget
+ *			 pe, where to store the entry
+ *			 line, CT_PW_LINE bytes for pw_read()
+ *	 Return: 1 if pe was set, 0 when there are no more entries
+ */
+int next_pwent(struct pwlist *pl, int i, FILE *fp, struct pwent *pe,
+			   char *line)
+{
+	if (fp != NULL)
+		return pw_read(fp, pe, line, CT_PW_LINE);
+
+	if (i >= pl->n)
+		return 0;
+
+	*pe = pl->ents[i];
+	return 1;
+}
+
+/*
+ *	scan_box()
+ *	Purpose: format the rows of one container into its buffer
+ *	 Method: The container's own etc/passwd is parsed with pw_load(), not
+ *			 looked up through the host's NSS, or read a line at a time with
+ *			 pw_read() if it does not fit --memory-limit, and its records are
+ *			 read with a private llf_ handle. The lastlog inside a container
+ *			 is indexed by the container's own UIDs; only the UID column is
+ *			 translated through DIR/NAME.uid_map.
+ *	 Errors: Problems are reported on stderr, labeled with the container,
+ *			 and mark the box failed; other containers are still scanned.
+ */
+void scan_box(struct box *bp)
+{
+	char path[PATH_MAX];
+	struct idrange map[CT_MAX_MAP];
+	struct pwlist pl;
+	struct pwent pe;
+	char line[CT_PW_LINE];
+	FILE *pw_fp = NULL;				//etc/passwd, if pw_load() ran out
+	struct llfile *lf;
+	int nmap, i;
+
+	bp->cap = 64 * (ROW_MAX + CT_PREFIX);
+	if ( (bp->buf = malloc(bp->cap)) == NULL )
+	{
+		perror(bp->name);
+		bp->failed = 1;
+		return;
+	}
+
+	snprintf(path, PATH_MAX, "%s/%s%s", ct_dir, bp->name, CT_MAP_SUFFIX);
+	nmap = load_map(path, map);
+
+	snprintf(path, PATH_MAX, "%s/%s%s", ct_dir, bp->name, CT_PASSWD);
+	if (pw_load(path, &pl) == -1 &&
+		(errno != ENOMEM || (pw_fp = fopen(path, "r")) == NULL))
+	{
+		perror(path);
+		bp->failed = 1;
+		return;
+	}
+
+	snprintf(path, PATH_MAX, "%s/%s%s", ct_dir, bp->name, CT_LASTLOG);
+	if ( (lf = llf_open(path)) == NULL )
+	{
+		perror(path);
+		pw_free(&pl);
+		if (pw_fp != NULL)
+			fclose(pw_fp);
+		bp->failed = 1;
+		return;
+	}
+
+	for (i = 0; next_pwent(&pl, i, pw_fp, &pe, line); i++)
+	{
+		struct lastlog *ll = NULL;
+		struct row r;
+		char *out = bp->buf + bp->len;
+		int len;
+
+		if (llf_seek(lf, pe.uid) == 0)
+			ll = llf_read(lf);
+
+		if (ct_keep(ll, ct_days) == 0)
+			continue;
+
+		r.name = pe.name;
+		r.uid = pe.uid;
+		r.found = (ll != NULL);
+		if (ll)
+			r.ll = *ll;
+
+		len = sprintf(out, "%-16.16s %-10lu ", bp->name,
+					  map_uid(map, nmap, r.uid));
+		len += format_row(out + len, &r);
+
+		if (grow_box(bp, len) == -1)
+		{
+			perror(bp->name);
+			bp->failed = 1;
+			break;
+		}
+	}
+
+	llf_close(lf);
+	pw_free(&pl);
+	if (pw_fp != NULL)
+		fclose(pw_fp);
+}
+
+/*
+ *	scan_worker()
+ *	Purpose: thread body, scan containers until none are left
+ *	 Return: NULL, so it can be passed to pthread_create()
+ */
+void *scan_worker(void *arg)
+{
+	(void) arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&ct_lock);
+		int i = next_box++;
+		pthread_mutex_unlock(&ct_lock);
+
+		if (i >= num_boxes)
+			return NULL;
+
+		scan_box(&boxes[i]);
+
+		pthread_mutex_lock(&ct_lock);
+		boxes[i].done = 1;
+		pthread_cond_broadcast(&ct_done);
+		pthread_mutex_unlock(&ct_lock);
+	}
+}
@@ -0,0 +1,7 @@
+/*
+ * containers.h - header file with functions located in containers.c
+ */
+
+#include <lastlog.h>
+
+int scan_containers(char *, int (*)(struct lastlog *, long), long, int);
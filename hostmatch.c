@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostmatch.h"
+#include "mem.h"
+
+#define MATCH_BIT		0x80000000u	//set in a transition into a match state
+#define HM_LINE			1024		//longest pattern line
+
+/*
+ * hm_pat - one pattern, as given to hm_add(), folded to lower case
+ */
+struct hm_pat {
+	char *text;						//the literal
+	int suffix;						//only match at the end of the host
+};
+
+static struct hm_pat *pats;			//patterns added since the last build
+static int num_pats;
+static int cap_pats;
+static unsigned char cls[256];		//byte -> class, 0 for bytes in no pattern
+static int num_cls;					//classes, including 0 and the end class
+static int end_cls;					//class of the end of the host
+static uint32_t *delta;				//[state * num_cls + class] -> next, which
+									//is state * num_cls, | MATCH_BIT
+static int built;					//delta is ready
+
+static int fold(int);
+
+/*
+ *	hm_add()
+ *	Purpose: add a pattern to the matcher
+ *	  Input: pattern, a literal that may appear anywhere in the host, or
+ *				"*LITERAL" for one that must end it, e.g. "*.example.com"
+ *	 Return: 0 on success, -1 if memory ran out or the pattern is empty
+ *			 (errno is EINVAL)
+ *	   Note: Matching ignores case. hm_build() must be called after adding.
+ */
+int hm_add(const char *pattern)
+{
+	int suffix = (pattern[0] == '*');
+	char *text;
+	int i;
+
+	if (pattern[suffix] == '\0')
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (num_pats == cap_pats)
+	{
+		struct hm_pat *bigger = mem_realloc(pats, (2 * cap_pats + 64) *
+											sizeof(struct hm_pat));
+		if (bigger == NULL)
+			return -1;
+		pats = bigger;
+		cap_pats = 2 * cap_pats + 64;
+	}
+
+	if ( (text = strdup(pattern + suffix)) == NULL )
+		return -1;
+	for (i = 0; text[i] != '\0'; i++)
+		text[i] = fold(text[i]);
+
+	pats[num_pats].text = text;
+	pats[num_pats].suffix = suffix;
+	num_pats++;
+	built = 0;
+
+	return 0;
+}
+
+/*
+ *	hm_build()
+ *	Purpose: compile the patterns into a DFA for hm_match()
+ *	 Return: 0 on success, -1 if memory ran out or the tables would go over
+ *			 the memory budget (errno is ENOMEM; see mem.c)
+ *	 Method: Aho-Corasick. Bytes are first mapped to classes: one for each
+ *			 byte (case folded) used by some pattern, 0 for all others, and
+ *			 one more for the end of the host, which suffix patterns end
+ *			 with. The trie of the patterns is built in a table of
+ *			 num_cls transitions per state, then a breadth-first pass
+ *			 fills in every missing transition from the state's failure
+ *			 link, so matching never follows links: one table load per
+ *			 byte. A state is marked if it or a state on its failure chain
+ *			 ends a pattern. Hostname alphabets are small, so the table is
+ *			 about 40 transitions per pattern character.
+ */
+int hm_build()
+{
+	uint32_t *fail, *queue;
+	size_t states = 1, total = 1;
+	int i, k, c, head = 0, tail = 0;
+
+	memset(cls, 0, sizeof(cls));
+	num_cls = 1;
+	for (i = 0; i < num_pats; i++)
+	{
+		const unsigned char *p = (const unsigned char *) pats[i].text;
+
+		for (; *p != '\0'; p++)
+			if (cls[*p] == 0)
+				cls[*p] = num_cls++;
+		total += strlen(pats[i].text) + 1;
+	}
+	for (c = 'A'; c <= 'Z'; c++)				//upper case as lower
+		cls[c] = cls[c - 'A' + 'a'];
+	end_cls = num_cls++;
+
+	mem_free(delta);
+	delta = mem_calloc(total * num_cls, sizeof(uint32_t));
+	fail = mem_calloc(total, sizeof(uint32_t));
+	queue = mem_alloc(total * sizeof(uint32_t));
+	if (delta == NULL || fail == NULL || queue == NULL)
+	{
+		mem_free(delta);
+		mem_free(fail);
+		mem_free(queue);
+		delta = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < num_pats; i++)				//the trie; 0 is no edge
+	{
+		const unsigned char *p = (const unsigned char *) pats[i].text;
+		int len = strlen(pats[i].text) + pats[i].suffix;	//+ end class
+		uint32_t s = 0;
+
+		for (k = 0; k < len; k++)
+		{
+			c = (p[k] != '\0') ? cls[p[k]] : end_cls;
+			if (delta[s + c] == 0)
+				delta[s + c] = states++ * num_cls;
+			s = delta[s + c];
+		}
+		fail[s / num_cls] |= MATCH_BIT;			//s ends a pattern
+	}
+
+	for (c = 0; c < num_cls; c++)				//depth 1: links to the root
+		if (delta[c] != 0)
+			queue[tail++] = delta[c];
+
+	while (head < tail)							//breadth first
+	{
+		uint32_t s = queue[head++];
+		uint32_t f = fail[s / num_cls] & ~MATCH_BIT;
+
+		fail[s / num_cls] |= fail[f / num_cls] & MATCH_BIT;
+
+		for (c = 0; c < num_cls; c++)
+		{
+			uint32_t t = delta[s + c] & ~MATCH_BIT;
+
+			if (t == 0)
+				delta[s + c] = delta[f + c] & ~MATCH_BIT;
+			else
+			{
+				fail[t / num_cls] = (fail[t / num_cls] & MATCH_BIT) |
+									(delta[f + c] & ~MATCH_BIT);
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	for (i = 0; (size_t) i < states * num_cls; i++)	//mark match targets
+		if (fail[(delta[i] & ~MATCH_BIT) / num_cls] & MATCH_BIT)
+			delta[i] |= MATCH_BIT;
+
+	mem_free(fail);
+	mem_free(queue);
+	built = 1;
+
+	return 0;
+}
+
+/*
+ *	hm_load()
+ *	Purpose: read patterns from a file, one per line, and build the matcher
+ *	 Return: number of patterns, or -1 on error (errno is set, unless
+ *			 memory ran out)
+ *	   Note: Blank lines and lines starting with '#' are skipped, as is
+ *			 white space around a pattern.
+ */
+int hm_load(char *path)
+{
+	char line[HM_LINE];
+	FILE *fp = fopen(path, "r");
+	int n = 0;
+
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, HM_LINE, fp) != NULL)
+	{
+		char *p = line + strspn(line, " \t");
+		char *end = p + strcspn(p, " \t\r\n");
+
+		*end = '\0';
+		if (*p == '\0' || *p == '#')
+			continue;
+		if (hm_add(p) == -1)
+		{
+			fclose(fp);
+			return -1;
+		}
+		n++;
+	}
+
+	fclose(fp);
+
+	return (hm_build() == -1) ? -1 : n;
+}
+
+/*
+ *	hm_match()
+ *	Purpose: test a host against every pattern at once
+ *	  Input: host, len, the host, e.g. an ll_field() view of ll_host
+ *	 Return: 1 if some pattern matches, 0 if none does or hm_build() has
+ *			 not been called
+ *	 Method: One DFA step per byte, stopping at the first match; the end
+ *			 class is fed last, for suffix patterns.
+ */
+int hm_match(const char *host, int len)
+{
+	const unsigned char *p = (const unsigned char *) host;
+	uint32_t s = 0;
+	int i;
+
+	if (!built)
+		return 0;
+
+	for (i = 0; i < len; i++)
+	{
+		s = delta[(s & ~MATCH_BIT) + cls[p[i]]];
+		if (s & MATCH_BIT)
+			return 1;
+	}
+
+	return (delta[s + end_cls] & MATCH_BIT) != 0;
+}
+
+/*
+ *	fold() - lower case an ASCII letter, as hostnames compare
+ */
+static int fold(int c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
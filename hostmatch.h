@@ -0,0 +1,8 @@
+/*
+ * hostmatch.h - header file with functions located in hostmatch.c
+ */
+
+int hm_add(const char *);
+int hm_build();
+int hm_load(char *);
+int hm_match(const char *, int);
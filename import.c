@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <lastlog.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "import.h"
+#include "lllib.h"
+#include "prof.h"
+#include "render.h"
+
+#define PART_ROWS		4096		//rows a part's table grows by
+#define NO_UID			-1			//user not resolved (yet)
+
+/*
+ * upd - one input row: who logged in, and the record to store for them
+ */
+struct upd {
+	char *name;						//user column, in the input text, or NULL
+	int uid;						//UID, NO_UID until the name is resolved
+	long seq;						//row number, so a later row wins a tie
+	struct lastlog ll;				//the record, as it will be written
+};
+
+/*
+ * part - a slice of the input, parsed by one thread into its own table
+ */
+struct part {
+	char *start;					//first char of the slice
+	char *end;						//one past the last; a newline or the end
+	struct upd *rows;				//rows parsed
+	int n;							//rows in use
+	int cap;						//rows allocated
+	long bad;						//lines that could not be parsed
+	int failed;						//memory ran out
+};
+
+/*
+ * name_slot - open addressing hash table entry, a user name and its UID
+ */
+struct name_slot {
+	char *name;						//NULL for an empty slot
+	int uid;						//NO_UID if the name is unknown
+};
+
+/*
+ * import_stats - what a run did, for the summary line
+ */
+struct import_stats {
+	long rows;						//rows parsed
+	long bad;						//lines skipped as malformed
+	long unknown;					//rows whose user could not be resolved
+	long older;						//records not newer than the file's
+	long written;					//records written
+};
+
+static char *in_text;				//the whole input, split in place
+static int in_json;					//input is NDJSON, not CSV
+static struct passwd *(*im_lookup)(char *);	//user name -> passwd entry
+static struct name_slot *names;		//names seen, resolved once each
+static unsigned long name_mask;		//slots in names, minus one
+static struct import_stats stats;
+
+int cmp_upd(const void *, const void *);
+void copy_field(char *, int, const char *);
+char *json_string(char **);
+int load_input(char *);
+int name_uid(char *);
+struct upd *new_row(struct part *);
+char *next_csv(char **);
+int parse_csv(char *, struct upd *);
+int parse_json(char *, struct upd *);
+void *parse_part(void *);
+int resolve_name(char *);
+char *skip_ws(char *);
+int write_updates(char *, struct upd **, int);
+
+/*
+ *	import_file()
+ *	Purpose: load login records exported from another system into a lastlog
+ *	  Input: src, the export: CSV lines of user,time,line,host or NDJSON
+ *				objects with "user" (or "uid"), "time", "line" and "host"
+ *			 dst, the lastlog file, created if it does not exist
+ *			 lookup, resolves a user name, as getpwnam()
+ *			 threads, number of threads parsing the input
+ *	 Output: a summary line of rows read, skipped and written
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: The input is read into one buffer, cut at line boundaries into
+ *			 a part per thread, and each part is parsed in place on its own
+ *			 thread. Each distinct user name is then resolved once, through
+ *			 a hash table. The rows are sorted by UID, and for each UID the
+ *			 latest login is kept; write_updates() stores it if it is newer
+ *			 than what dst already holds.
+ *	   Note: A first CSV line that does not parse is taken as a header. A
+ *			 user that is not a known name but is a number is used as a UID,
+ *			 as -u does. time is in seconds since the epoch.
+ */
+int import_file(char *src, char *dst, struct passwd *(*lookup)(char *),
+				int threads)
+{
+	pthread_t tids[MAX_THREADS];
+	struct part parts[MAX_THREADS];
+	struct upd **all;
+	size_t size;
+	int started[MAX_THREADS];
+	int i, j, n = 0, rv;
+
+	im_lookup = lookup;
+	memset(&stats, 0, sizeof(stats));
+
+	prof_enter("import_file");
+
+	if (load_input(src) == -1)
+	{
+		perror(src);
+		prof_exit();
+		return -1;
+	}
+
+	size = strlen(in_text);
+	in_json = (*skip_ws(in_text) == '{');
+
+	for (i = 0; i < threads; i++)			//cut into parts at newlines
+	{
+		memset(&parts[i], 0, sizeof(struct part));
+		parts[i].start = (i == 0) ? in_text : parts[i - 1].end;
+		if (*parts[i].start == '\n')		//the newline ends part i - 1
+			parts[i].start++;
+		parts[i].end = (i == threads - 1) ? in_text + size
+										  : in_text + size * (i + 1) / threads;
+
+		if (parts[i].end < parts[i].start)
+			parts[i].end = parts[i].start;
+		while (*parts[i].end != '\0' && *parts[i].end != '\n')
+			parts[i].end++;
+	}
+
+	for (i = 1; i < threads; i++)			//part 0 is parsed here
+		started[i] = pthread_create(&tids[i], NULL, parse_part,
+									&parts[i]) == 0;
+	parse_part(&parts[0]);
+
+	for (i = 1; i < threads; i++)
+		if (started[i])
+			pthread_join(tids[i], NULL);
+		else
+			parse_part(&parts[i]);
+
+	for (i = 0; i < threads; i++)
+	{
+		if (parts[i].failed)
+		{
+			fprintf(stderr, "alastlog: out of memory reading %s\n", src);
+			exit(1);
+		}
+		n += parts[i].n;
+		stats.bad += parts[i].bad;
+	}
+
+	stats.rows = n;
+	for (name_mask = 1; name_mask < 2 * (unsigned long) n; name_mask *= 2)
+		;
+	if ( (all = malloc((n + 1) * sizeof(struct upd *))) == NULL ||
+		 (names = calloc(name_mask, sizeof(struct name_slot))) == NULL )
+	{
+		perror("alastlog");
+		exit(1);
+	}
+	name_mask--;
+
+	n = 0;
+	for (i = 0; i < threads; i++)			//resolve users, in input order
+		for (j = 0; j < parts[i].n; j++)
+		{
+			struct upd *u = &parts[i].rows[j];
+
+			if (u->uid == NO_UID && (u->uid = name_uid(u->name)) == NO_UID)
+			{
+				stats.unknown++;
+				continue;
+			}
+			u->seq = n;
+			all[n++] = u;
+		}
+
+	qsort(all, n, sizeof(struct upd *), cmp_upd);
+
+	for (i = j = 0; i < n; i++)				//keep the last row of each UID
+		if (i + 1 == n || all[i + 1]->uid != all[i]->uid)
+			all[j++] = all[i];
+
+	rv = write_updates(dst, all, j);
+
+	if (rv == 0)
+		printf("import: %ld rows, %ld bad, %ld unknown users, "
+			   "%ld not newer, %ld written\n", stats.rows, stats.bad,
+			   stats.unknown, stats.older, stats.written);
+
+	for (i = 0; i < threads; i++)
+		free(parts[i].rows);
+	free(all);
+	free(names);
+	free(in_text);
+	prof_exit();
+
+	return rv;
+}
+
+/*
+ *	cmp_upd() - qsort() comparison: by UID, then time, then input order
+ */
+int cmp_upd(const void *a, const void *b)
+{
+	const struct upd *x = *(struct upd * const *) a;
+	const struct upd *y = *(struct upd * const *) b;
+
+	if (x->uid != y->uid)
+		return (x->uid > y->uid) - (x->uid < y->uid);
+	if (x->ll.ll_time != y->ll.ll_time)
+		return (x->ll.ll_time > y->ll.ll_time) -
+			   (x->ll.ll_time < y->ll.ll_time);
+
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+ *	copy_field()
+ *	Purpose: store a string in a fixed-size lastlog field
+ *	   Note: As utmp fields, a string that fills the field has no '\0'; a
+ *			 longer one is cut. The field is already zeroed.
+ */
+void copy_field(char *field, int size, const char *str)
+{
+	size_t len = strlen(str);
+
+	memcpy(field, str, (len < (size_t) size) ? len : (size_t) size);
+}
+
+/*
+ *	json_string()
+ *	Purpose: decode a JSON string in place
+ *	  Input: pp, points at the opening '"'; moved past the closing one
+ *	 Return: the decoded string, or NULL if it is not terminated
+ *	   Note: \uXXXX escapes above 0x7f become '?'; lastlog fields are bytes,
+ *			 and login names and hosts are ASCII in practice.
+ */
+char *json_string(char **pp)
+{
+	char *in = *pp + 1, *out = in, *start = in;
+
+	while (*in != '"')
+	{
+		if (*in == '\0')
+			return NULL;
+		if (*in != '\\')
+		{
+			*out++ = *in++;
+			continue;
+		}
+
+		switch (*++in)
+		{
+			case 'b': *out++ = '\b'; break;
+			case 'f': *out++ = '\f'; break;
+			case 'n': *out++ = '\n'; break;
+			case 'r': *out++ = '\r'; break;
+			case 't': *out++ = '\t'; break;
+			case 'u':
+			{
+				char hex[5] = {0}, *end;
+				long c;
+
+				if (strlen(in + 1) < 4)
+					return NULL;
+				memcpy(hex, in + 1, 4);
+				c = strtol(hex, &end, 16);
+				if (*end != '\0')
+					return NULL;
+				*out++ = (c < 0x80) ? c : '?';
+				in += 4;
+				break;
+			}
+			case '\0': return NULL;
+			default: *out++ = *in; break;		//\" \\ \/
+		}
+		in++;
+	}
+
+	*out = '\0';
+	*pp = in + 1;
+
+	return start;
+}
+
+/*
+ *	load_input()
+ *	Purpose: read the whole input file into in_text, '\0' terminated
+ *	 Return: 0 on success, -1 on error (errno is set)
+ */
+int load_input(char *path)
+{
+	struct stat st;
+	ssize_t len = 0, amt = 0;
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1 || (in_text = malloc(st.st_size + 1)) == NULL)
+	{
+		close(fd);
+		return -1;
+	}
+
+	while (len < st.st_size &&
+		   (amt = read(fd, in_text + len, st.st_size - len)) > 0)
+		len += amt;
+
+	close(fd);
+	in_text[len] = '\0';
+
+	return (amt == -1) ? -1 : 0;
+}
+
+/*
+ *	name_uid()
+ *	Purpose: find the UID of a user, asking lookup only the first time a
+ *			 name is seen
+ *	 Return: the UID, or NO_UID if the user is unknown
+ *	 Method: FNV-1a hash, linear probing. The table has at least twice as
+ *			 many slots as there are rows, so it never fills.
+ */
+int name_uid(char *name)
+{
+	unsigned long h = 14695981039346656037UL;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) name; *p != '\0'; p++)
+		h = (h ^ *p) * 1099511628211UL;
+
+	for (h &= name_mask; names[h].name != NULL; h = (h + 1) & name_mask)
+		if (strcmp(names[h].name, name) == 0)
+			return names[h].uid;
+
+	names[h].name = name;
+	names[h].uid = resolve_name(name);
+
+	return names[h].uid;
+}
+
+/*
+ *	new_row()
+ *	Purpose: add a zeroed row to a part's table
+ *	 Return: the row, or NULL if memory ran out (the part is marked failed)
+ */
+struct upd *new_row(struct part *pp)
+{
+	if (pp->n == pp->cap)
+	{
+		struct upd *bigger = realloc(pp->rows,
+									 (pp->cap + PART_ROWS) * sizeof(struct upd));
+		if (bigger == NULL)
+		{
+			pp->failed = 1;
+			return NULL;
+		}
+		pp->rows = bigger;
+		pp->cap += PART_ROWS;
+	}
+
+	memset(&pp->rows[pp->n], 0, sizeof(struct upd));
+	pp->rows[pp->n].uid = NO_UID;
+
+	return &pp->rows[pp->n++];
+}
+
+/*
+ *	next_csv()
+ *	Purpose: split the next field off a CSV line, in place
+ *	  Input: pp, the rest of the line; moved past the field and its ','
+ *	 Return: the field, unquoted, or NULL if the line has no more fields
+ *	   Note: A field may be in double quotes, with "" for a quote inside.
+ */
+char *next_csv(char **pp)
+{
+	char *in = *pp, *out, *start;
+
+	if (in == NULL)
+		return NULL;
+
+	if (*in != '"')
+	{
+		char *comma = strchr(in, ',');
+
+		*pp = (comma != NULL) ? comma + 1 : NULL;
+		if (comma != NULL)
+			*comma = '\0';
+		return in;
+	}
+
+	start = out = ++in;
+	while (*in != '\0')
+	{
+		if (*in == '"' && in[1] == '"')
+			in++;
+		else if (*in == '"')
+			break;
+		*out++ = *in++;
+	}
+
+	if (*in == '"')
+		in++;
+	*pp = (*in == ',') ? in + 1 : NULL;
+	*out = '\0';
+
+	return start;
+}
+
+/*
+ *	parse_csv()
+ *	Purpose: parse one CSV line: user,time[,line[,host]]
+ *	 Return: 0 on success, -1 if the line is malformed
+ */
+int parse_csv(char *line, struct upd *u)
+{
+	char *user = next_csv(&line);
+	char *time = next_csv(&line);
+	char *tty = next_csv(&line);
+	char *host = next_csv(&line);
+	char *end;
+	long t;
+
+	if (user == NULL || user[0] == '\0' || time == NULL)
+		return -1;
+
+	t = strtol(time, &end, 10);
+	if (time[0] == '\0' || *end != '\0' || t < 0 || t > INT_MAX)
+		return -1;
+
+	u->name = user;
+	u->ll.ll_time = t;
+	if (tty)
+		copy_field(u->ll.ll_line, UT_LINESIZE, tty);
+	if (host)
+		copy_field(u->ll.ll_host, UT_HOSTSIZE, host);
+
+	return 0;
+}
+
+/*
+ *	parse_json()
+ *	Purpose: parse one NDJSON line, a flat object
+ *	 Return: 0 on success, -1 if the line is malformed or lacks a user or
+ *			 a time
+ *	   Note: Keys other than user, uid, time, line and host are skipped if
+ *			 their values are strings or integers.
+ */
+int parse_json(char *p, struct upd *u)
+{
+	char *key, *str, *end;
+	long num = 0, t = -1;
+
+	p = skip_ws(p);
+	if (*p++ != '{')
+		return -1;
+
+	while (*(p = skip_ws(p)) != '}')
+	{
+		if (*p != '"' || (key = json_string(&p)) == NULL)
+			return -1;
+		p = skip_ws(p);
+		if (*p++ != ':')
+			return -1;
+		p = skip_ws(p);
+
+		str = NULL;
+		if (*p == '"')
+		{
+			if ( (str = json_string(&p)) == NULL )
+				return -1;
+		}
+		else
+		{
+			num = strtol(p, &end, 10);
+			if (end == p || num < 0 || num > INT_MAX)
+				return -1;
+			p = end;
+		}
+
+		if (strcmp(key, "user") == 0 && str)
+			u->name = str;
+		else if ((strcmp(key, "uid") == 0 || strcmp(key, "user") == 0) && !str)
+			u->uid = num;
+		else if (strcmp(key, "time") == 0 && !str)
+			t = num;
+		else if (strcmp(key, "line") == 0 && str)
+			copy_field(u->ll.ll_line, UT_LINESIZE, str);
+		else if (strcmp(key, "host") == 0 && str)
+			copy_field(u->ll.ll_host, UT_HOSTSIZE, str);
+
+		p = skip_ws(p);
+		if (*p == ',')
+			p++;
+		else if (*p != '}')
+			return -1;
+	}
+
+	if (t == -1 || (u->name == NULL && u->uid == NO_UID))
+		return -1;
+
+	u->ll.ll_time = t;
+	return 0;
+}
+
+/*
+ *	parse_part()
+ *	Purpose: thread body, parse the lines of one part into its table
+ *	 Return: NULL, so it can be passed to pthread_create()
+ *	   Note: Blank lines are skipped. Each newline becomes a '\0', so the
+ *			 parts must not overlap.
+ */
+void *parse_part(void *arg)
+{
+	struct part *pp = arg;
+	char *p = pp->start;
+	int header = !in_json && pp->start == in_text;	//may be a header line
+
+	while (p < pp->end)
+	{
+		char *eol = memchr(p, '\n', pp->end - p);
+		struct upd *u;
+
+		if (eol == NULL)
+			eol = pp->end;
+		*eol = '\0';
+		if (eol > p && eol[-1] == '\r')
+			eol[-1] = '\0';
+
+		if (*p != '\0')
+		{
+			if ( (u = new_row(pp)) == NULL )
+				return NULL;
+
+			if ((in_json ? parse_json(p, u) : parse_csv(p, u)) == -1)
+			{
+				pp->n--;						//drop it
+				if (!header)
+					pp->bad++;
+			}
+			header = 0;
+		}
+
+		p = eol + 1;
+	}
+
+	return NULL;
+}
+
+/*
+ *	resolve_name()
+ *	Purpose: turn a user column into a UID
+ *	 Return: the UID of the user of that name or, failing that, the column
+ *			 as a number; NO_UID if it is neither
+ */
+int resolve_name(char *name)
+{
+	struct passwd *pw = im_lookup(name);
+	char *end;
+	long uid;
+
+	if (pw != NULL)
+		return pw->pw_uid;
+
+	uid = strtol(name, &end, 10);
+	if (name[0] == '\0' || *end != '\0' || uid < 0 || uid > INT_MAX)
+		return NO_UID;
+
+	return uid;
+}
+
+/*
+ *	skip_ws() - skip spaces and tabs
+ */
+char *skip_ws(char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	return p;
+}
+
+/*
+ *	write_updates()
+ *	Purpose: store the imported records that are newer than the file's
+ *	  Input: dst, the lastlog file
+ *			 ups, one row per UID, in UID order
+ *			 n, number of rows
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: The current records are read in UID order through an llf_
+ *			 handle, which skips holes without reading. The records to
+ *			 write then go to ll_write_recs(), which coalesces consecutive
+ *			 UIDs into one pwritev() and writes nothing between them, so a
+ *			 sparse file stays sparse.
+ */
+int write_updates(char *dst, struct upd **ups, int n)
+{
+	struct lastlog **lls = malloc((n + 1) * sizeof(struct lastlog *));
+	int *recs = malloc((n + 1) * sizeof(int));
+	struct llfile *lf;
+	struct lastlog *cur;
+	int fd, i, k = 0, rv = 0;
+
+	if (lls == NULL || recs == NULL)
+	{
+		perror("alastlog");
+		exit(1);
+	}
+
+	if ( (fd = open(dst, O_RDWR | O_CREAT, 0644)) == -1 )
+	{
+		perror(dst);
+		return -1;
+	}
+
+	if ( (lf = llf_open(dst)) == NULL )
+	{
+		perror(dst);
+		close(fd);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		cur = (llf_seek(lf, ups[i]->uid) == 0) ? llf_read(lf) : NULL;
+
+		if (ups[i]->ll.ll_time == 0 ||
+			(cur != NULL && cur->ll_time >= ups[i]->ll.ll_time))
+		{
+			stats.older++;
+			continue;
+		}
+
+		recs[k] = ups[i]->uid;
+		lls[k++] = &ups[i]->ll;
+	}
+
+	llf_close(lf);
+
+	if (ll_write_recs(fd, recs, lls, k) == -1 || fsync(fd) == -1)
+	{
+		perror(dst);
+		rv = -1;
+	}
+	else
+		stats.written = k;
+
+	close(fd);
+	free(lls);
+	free(recs);
+
+	return rv;
+}
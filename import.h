@@ -0,0 +1,7 @@
+/*
+ * import.h - header file with functions located in import.c
+ */
+
+#include <pwd.h>
+
+int import_file(char *, char *, struct passwd *(*)(char *), int);
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE					//for strcasestr()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "hostmatch.h"
+
+/*
+ * llhost - host matcher benchmark: times hm_match(), the automaton behind
+ * --host-match-file, against checking each pattern in turn, on the same
+ * hosts, and checks that both give the same answers.
+ */
+
+#define NS_IN_SEC	1000000000L
+#define HOST_SIZE	256				//as ll_host
+#define PAT_LINE	1024
+
+static char **pats;					//the patterns, as given to hm_add()
+static int num_pats;
+
+int add_pattern(const char *);
+void make_hosts(char (*)[HOST_SIZE], int, int);
+void make_patterns(int);
+int naive_match(const char *);
+long now_ns();
+int read_patterns(char *);
+
+/*
+ * main()
+ * Method: "llhost [-p PATTERNS] [-n HOSTS] [-N NAIVE_HOSTS] [-f FILE]".
+ *		   Patterns come from FILE (same format as --host-match-file) or
+ *		   are made up: PATTERNS/2 suffixes "*.zoneN.example" and as many
+ *		   substrings "scanN-". Hosts are made up, about one in eight
+ *		   matching. The per-pattern loop is much slower, so it only runs
+ *		   on the first NAIVE_HOSTS hosts.
+ * Return: 0 if both matchers agree, 1 on bad usage or if they differ.
+ */
+int main(int ac, char *av[])
+{
+	char *file = NULL;
+	int npat = 20000, nhost = 200000, nnaive = 2000, opt;
+
+	while ((opt = getopt(ac, av, "f:n:N:p:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f': file = optarg; break;
+			case 'n': nhost = atoi(optarg); break;
+			case 'N': nnaive = atoi(optarg); break;
+			case 'p': npat = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: llhost [-p PATTERNS] [-n HOSTS] "
+						"[-N NAIVE_HOSTS] [-f FILE]\n");
+				exit(1);
+		}
+	}
+
+	if (nhost < 1 || npat < 2 || nnaive < 1)
+	{
+		fprintf(stderr, "llhost: counts must be positive\n");
+		exit(1);
+	}
+	if (nnaive > nhost)
+		nnaive = nhost;
+
+	char (*hosts)[HOST_SIZE] = calloc(nhost, HOST_SIZE);
+	char *fast = malloc(nhost);
+	long t, build_ns, fast_ns, naive_ns;
+	int i, hits = 0, diff = 0;
+
+	if (hosts == NULL || fast == NULL)
+	{
+		perror("llhost");
+		exit(1);
+	}
+
+	if (file != NULL && read_patterns(file) == -1)
+	{
+		perror(file);
+		exit(1);
+	}
+	if (file == NULL)
+		make_patterns(npat);
+	make_hosts(hosts, nhost, npat / 2);
+
+	t = now_ns();
+	if (hm_build() == -1)
+	{
+		perror("hm_build");
+		exit(1);
+	}
+	build_ns = now_ns() - t;
+
+	t = now_ns();
+	for (i = 0; i < nhost; i++)
+		hits += (fast[i] = hm_match(hosts[i], strnlen(hosts[i], HOST_SIZE)));
+	fast_ns = now_ns() - t;
+
+	t = now_ns();
+	for (i = 0; i < nnaive; i++)
+		diff += (naive_match(hosts[i]) != fast[i]);
+	naive_ns = now_ns() - t;
+
+	printf("%d patterns, %d hosts, %d match; build %.1fms\n", num_pats, nhost,
+		   hits, build_ns / 1e6);
+	printf("  automaton   %10.0f hosts/s  %8.1fns/host\n",
+		   nhost * (double) NS_IN_SEC / fast_ns, (double) fast_ns / nhost);
+	printf("  per-pattern %10.0f hosts/s  %8.1fns/host  (%d hosts)\n",
+		   nnaive * (double) NS_IN_SEC / naive_ns, (double) naive_ns / nnaive,
+		   nnaive);
+
+	if (diff != 0)
+	{
+		fprintf(stderr, "llhost: matchers differ on %d hosts\n", diff);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *	add_pattern() - keep a copy of a pattern and give it to hm_add()
+ */
+int add_pattern(const char *p)
+{
+	char **bigger = realloc(pats, (num_pats + 1) * sizeof(char *));
+
+	if (bigger == NULL || (bigger[num_pats] = strdup(p)) == NULL)
+		return -1;
+	pats = bigger;
+	num_pats++;
+
+	return hm_add(p);
+}
+
+/*
+ *	make_hosts()
+ *	Purpose: fill in hosts that look like ll_host values
+ *	 Method: Most are "hostN.siteM.net" or dotted quads, which match no
+ *			 made-up pattern; one in sixteen ends in a made-up zone and
+ *			 one in sixteen contains a made-up scanner name.
+ */
+void make_hosts(char (*hosts)[HOST_SIZE], int n, int zones)
+{
+	int i;
+
+	srandom(1);
+	for (i = 0; i < n; i++)
+	{
+		long r = random();
+
+		if (r % 16 == 0)
+			snprintf(hosts[i], HOST_SIZE, "h%ld.zone%ld.example",
+					 r % 1000, r % zones);
+		else if (r % 16 == 1)
+			snprintf(hosts[i], HOST_SIZE, "SCAN%ld-node.isp.net", r % zones);
+		else if (r % 2)
+			snprintf(hosts[i], HOST_SIZE, "host%ld.site%ld.net", r % 100000,
+					 r % 977);
+		else
+			snprintf(hosts[i], HOST_SIZE, "%ld.%ld.%ld.%ld", r & 255,
+					 (r >> 8) & 255, (r >> 16) & 255, (r >> 24) & 255);
+	}
+}
+
+/*
+ *	make_patterns() - made-up suffix and substring patterns, n in all
+ */
+void make_patterns(int n)
+{
+	char p[PAT_LINE];
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (i % 2)
+			snprintf(p, PAT_LINE, "*.zone%d.example", i / 2);
+		else
+			snprintf(p, PAT_LINE, "scan%d-", i / 2);
+		if (add_pattern(p) == -1)
+		{
+			perror("llhost");
+			exit(1);
+		}
+	}
+}
+
+/*
+ *	naive_match()
+ *	Purpose: the obvious matcher, for comparison: try every pattern
+ *	 Return: 1 if some pattern matches, 0 if none does
+ */
+int naive_match(const char *host)
+{
+	size_t hlen = strlen(host);
+	int i;
+
+	for (i = 0; i < num_pats; i++)
+	{
+		const char *p = pats[i];
+
+		if (p[0] == '*')
+		{
+			size_t plen = strlen(++p);
+
+			if (plen <= hlen && strcasecmp(host + hlen - plen, p) == 0)
+				return 1;
+		}
+		else if (strcasestr(host, p) != NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *	now_ns() - monotonic clock reading, in nanoseconds
+ */
+long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/*
+ *	read_patterns()
+ *	Purpose: read a pattern file, as hm_load() does, keeping a copy
+ *	 Return: 0 on success, -1 on error
+ */
+int read_patterns(char *path)
+{
+	char line[PAT_LINE];
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, PAT_LINE, fp) != NULL)
+	{
+		char *p = line + strspn(line, " \t");
+
+		p[strcspn(p, " \t\r\n")] = '\0';
+		if (*p != '\0' && *p != '#' && add_pattern(p) == -1)
+		{
+			fclose(fp);
+			return -1;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
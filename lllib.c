@@ -1,85 +1,633 @@
+#define _GNU_SOURCE					//for SEEK_DATA and SEEK_HOLE
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <lastlog.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "lllib.h"
+#include "mem.h"
+#include "prof.h"
 
-#define NRECS 512
+#define NRECS 512					//default window, records per buffer load
+#define MAX_WINDOW 65536			//largest window a config may set
 #define LLSIZE	(sizeof(struct lastlog))
 #define LL_NULL ((struct lastlog *) NULL)
+#define MAX_EXT 4096				//extents mapped before giving up
 
-static char llbuf[NRECS * LLSIZE];	//buffer storage
-static int num_recs;				//num in buffer
-static int cur_rec;					//next rec to read
-static int buf_start;				//overall starting index of buffer
-static int ll_fd = -1;				//file descriptor
+/*
+ * llfile - everything lllib knows about one open lastlog file. Each handle
+ * has its own buffer, so separate threads can each read their own file.
+ */
+struct llfile {
+	char *llbuf;					//current buffer: buf, or in the mapping
+	char *buf;						//buffer storage, nrecs records
+	int nrecs;						//window: records per buffer load
+	int backend;					//LL_READ, LL_PREAD or LL_MMAP
+	char *map;						//LL_MMAP: the whole file, else NULL
+	int num_recs;					//num in buffer
+	int cur_rec;					//next rec to read
+	int buf_start;					//overall starting index of buffer
+	int fd_rec;						//rec the file offset is at, -1 unknown
+	int ll_fd;						//file descriptor
+
+	off_t *ext;						//data extents, [start, end) byte pairs
+	int num_ext;					//number of extents in ext
+	int ext_ok;						//ext is valid for the open file
+	off_t ll_size;					//file size when the extents were mapped
+	int in_hole;					//ll_seek found a hole, ll_read -> zeros
+};
+
+static struct llfile *ll_cur;		//handle used by ll_open() and friends
+static struct lastlog zero_rec;		//returned for records inside holes
+static struct ll_conf conf = { NRECS, LL_READ, 1 };	//used by llf_open()
+static pthread_once_t conf_once = PTHREAD_ONCE_INIT;	//LL_CONF_FILE read
+static const char *backends[] = { "read", "pread", "mmap" };	//by LL_ id
+static struct ll_progress prog;		//totals for ll_progress()
+
+static int cmp_int(const void *, const void *);	//qsort() ints
+static void ll_count(uint64_t *, uint64_t);	//add to a prog total
+static void ll_conf_default();				//read LL_CONF_FILE
+static int ll_conf_read(char *);			//parse a config file
+static int ll_hole(struct llfile *, int);	//test for a hole
+static void ll_map_extents(struct llfile *);	//load extent map
+static int ll_reload(struct llfile *);		//load buffer
+static int ll_seek_buf(struct llfile *, int);	//position buffer
+
+
+/*
+ *	ll_field()
+ *	Purpose: decode a fixed-size string field of a lastlog record
+ *	  Input: str, the field, e.g. lp->ll_host
+ *			 size, the size of the field, e.g. UT_HOSTSIZE
+ *	 Return: a view of the field's text, not including any '\0'
+ *	 Method: memchr() for the terminator, bounded by size. The record is
+ *			 never written to, so this works on read-only or shared memory,
+ *			 and a field that uses all size chars keeps its last char.
+ *	   Note: glibc's memchr() compares 16 or 32 bytes per instruction, so
+ *			 scanning the 256-byte ll_host costs a few vector compares.
+ */
+struct ll_field ll_field(const char *str, int size)
+{
+	struct ll_field f = { str, size };
+	const char *end = memchr(str, '\0', size);
+
+	if (end != NULL)
+		f.len = end - str;
+
+	return f;
+}
 
-static int ll_reload();				//internal function to load buffer
+/*
+ *	ll_conf_get()
+ *	Purpose: get the configuration llf_open() uses
+ *	   Note: The first call reads LL_CONF_FILE, unless ll_conf_set() or
+ *			 ll_conf_load() came first. Without the file the defaults are
+ *			 a window of NRECS records, LL_READ, and one thread.
+ */
+void ll_conf_get(struct ll_conf *cp)
+{
+	pthread_once(&conf_once, ll_conf_default);
+	*cp = conf;
+}
 
+/*
+ *	ll_conf_set()
+ *	Purpose: set the configuration used by llf_open() from now on
+ *	   Note: Not safe while another thread is in llf_open().
+ */
+void ll_conf_set(const struct ll_conf *cp)
+{
+	pthread_once(&conf_once, ll_conf_default);
+	conf = *cp;
+}
 
 /*
- *	ll_open()
+ *	ll_conf_load()
+ *	Purpose: read a configuration file written by ll_conf_save()
+ *	 Return: 0 on success, -1 if the file cannot be read (errno is set)
+ *	 Method: Lines of "window N", "backend NAME" and "threads N". Unknown
+ *			 keys and out of range values are ignored, so the defaults
+ *			 stand for them.
+ */
+int ll_conf_load(char *path)
+{
+	pthread_once(&conf_once, ll_conf_default);
+
+	return ll_conf_read(path);
+}
+
+/*
+ *	ll_conf_read() - body of ll_conf_load(), also used by ll_conf_default()
+ */
+static int ll_conf_read(char *path)
+{
+	char key[32], val[32];
+	FILE *fp;
+	int n;
+
+	if ( (fp = fopen(path, "r")) == NULL )
+		return -1;
+
+	while (fscanf(fp, "%31s %31s", key, val) == 2)
+	{
+		n = atoi(val);
+		if (strcmp(key, "window") == 0 && n >= 1 && n <= MAX_WINDOW)
+			conf.window = n;
+		else if (strcmp(key, "threads") == 0 && n >= 1)
+			conf.threads = n;
+		else if (strcmp(key, "backend") == 0)
+			for (n = 0; n < LL_BACKENDS; n++)
+				if (strcmp(val, backends[n]) == 0)
+					conf.backend = n;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/*
+ *	ll_conf_save()
+ *	Purpose: write a configuration for ll_conf_load() to read
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: write PATH.tmp, then rename() it over PATH, so a reader never
+ *			 sees half a file
+ */
+int ll_conf_save(char *path, const struct ll_conf *cp)
+{
+	char tmp[PATH_MAX];
+	FILE *fp;
+
+	snprintf(tmp, PATH_MAX, "%s.tmp", path);
+	if ( (fp = fopen(tmp, "w")) == NULL )
+		return -1;
+
+	fprintf(fp, "window %d\nbackend %s\nthreads %d\n", cp->window,
+			ll_backend_name(cp->backend), cp->threads);
+
+	if (fclose(fp) == EOF)
+		return -1;
+
+	return rename(tmp, path);
+}
+
+/*
+ *	ll_backend_name() - name of a backend, as in the configuration file
+ */
+const char *ll_backend_name(int backend)
+{
+	return (backend >= 0 && backend < LL_BACKENDS) ? backends[backend] : "?";
+}
+
+/*
+ *	ll_progress()
+ *	Purpose: copy the running totals, safely from any thread
+ *	   Note: Each total is one aligned word, read and written with relaxed
+ *			 atomics: on the hot path that is a plain load, add and store,
+ *			 no locked instruction. Totals only ever grow, and a reader
+ *			 may see one a little behind another. Files read by several
+ *			 threads at once (--containers) may lose a few counts.
+ */
+void ll_progress(struct ll_progress *pp)
+{
+	pp->lookups = __atomic_load_n(&prog.lookups, __ATOMIC_RELAXED);
+	pp->holes = __atomic_load_n(&prog.holes, __ATOMIC_RELAXED);
+	pp->bytes = __atomic_load_n(&prog.bytes, __ATOMIC_RELAXED);
+	pp->rec = __atomic_load_n(&prog.rec, __ATOMIC_RELAXED);
+	pp->size = __atomic_load_n(&prog.size, __ATOMIC_RELAXED);
+}
+
+/*
+ *	ll_conf_default() - pthread_once() body, load LL_CONF_FILE if it exists
+ */
+static void ll_conf_default()
+{
+	ll_conf_read(LL_CONF_FILE);				//no file: keep the defaults
+}
+
+/*
+ *	ll_open(), ll_seek(), ll_read(), ll_prefetch(), ll_close()
+ *	Purpose: the single-file interface, for programs that read one lastlog
+ *			 at a time. Each is the llf_ function of the same name applied
+ *			 to a handle kept in lllib, so see those for details.
+ *	 Return: as the llf_ functions; ll_open() returns the file descriptor,
+ *			 or -1 on error
+ */
+int ll_open(char *fname)
+{
+	ll_close();							//at most one file open this way
+
+	if ( (ll_cur = llf_open(fname)) == NULL )
+		return -1;
+
+	return ll_cur->ll_fd;
+}
+
+int ll_seek(int rec)
+{
+	return (ll_cur == NULL) ? -1 : llf_seek(ll_cur, rec);
+}
+
+struct lastlog *ll_read()
+{
+	return (ll_cur == NULL) ? LL_NULL : llf_read(ll_cur);
+}
+
+int ll_prefetch(int *recs, int n)
+{
+	return (ll_cur == NULL) ? 0 : llf_prefetch(ll_cur, recs, n);
+}
+
+int ll_close()
+{
+	int value = 0;
+
+	if (ll_cur != NULL)
+		value = llf_close(ll_cur);
+
+	ll_cur = NULL;
+	return value;
+}
+
+/*
+ *	llf_open()
  *	Purpose: opens the filename given for read access.
- *	 Return: int of file descriptor on success
- *			 -1 on error
+ *	 Return: a new handle on success
+ *			 NULL on error (errno is set)
+ *	 Method: Also maps the data extents of the file once, see
+ *			 ll_map_extents(), so llf_seek() can answer records that fall in
+ *			 holes without any reads. The window and backend come from the
+ *			 configuration, see ll_conf_get(); LL_MMAP maps the whole file
+ *			 now, and falls back to LL_READ if the file is empty, its size
+ *			 is unknown, or mmap() fails. Under a memory budget (see mem.c)
+ *			 the window is halved until it takes at most half of what is
+ *			 left, so the caller keeps room for its own buffers.
  *	   Note: copied (with minor modifications), from utmplib.c file. Provided
  *			 in assignment files, also used in lecture 02.
  */
-int ll_open(char *fname)
+struct llfile *llf_open(char *fname)
 {
-	ll_fd = open(fname, O_RDONLY);
-	num_recs = 0;
-	cur_rec = 0;
-	buf_start = 0;
+	struct llfile *lf = malloc(sizeof(struct llfile));
+	struct ll_conf c;
+
+	if (lf == NULL)
+		return NULL;
+
+	ll_conf_get(&c);
+	prof_enter("ll_open");
+	lf->ll_fd = open(fname, O_RDONLY);
+	lf->nrecs = c.window;
+	lf->backend = c.backend;
+	lf->map = NULL;
+	lf->num_recs = 0;
+	lf->cur_rec = 0;
+	lf->buf_start = 0;
+	lf->fd_rec = 0;
+	lf->in_hole = 0;
+	lf->ext = NULL;
+	while (lf->nrecs > 1 && lf->nrecs * LLSIZE > mem_avail() / 2)
+		lf->nrecs /= 2;				//--memory-limit: smaller window
+	lf->buf = mem_alloc(lf->nrecs * LLSIZE);
+	lf->llbuf = lf->buf;
+	ll_map_extents(lf);
+
+	if (lf->backend == LL_MMAP && lf->ll_fd != -1)	//no mapping: use read()
+	{
+		if (!lf->ext_ok || lf->ll_size == 0 ||
+			(lf->map = mmap(NULL, lf->ll_size, PROT_READ, MAP_SHARED,
+							lf->ll_fd, 0)) == MAP_FAILED)
+		{
+			lf->map = NULL;
+			lf->backend = LL_READ;
+		}
+	}
+	prof_exit();
+
+	if (lf->ll_fd == -1 || lf->buf == NULL)
+	{
+		if (lf->ll_fd != -1)
+			close(lf->ll_fd);
+		free(lf->ext);
+		mem_free(lf->buf);
+		free(lf);
+		return NULL;
+	}
 
-	return ll_fd;
+	return lf;
 }
 
 /*
- *	ll_seek()
+ *	llf_seek()
  *	Purpose: reposition location where next record is read from
  *	 Return: -1 on error, 0 on success
- *	  Input: rec, the index (based on UID) of the record requested
- *	 Method: If the rec equals cur_rec, no seeking needed; the next record
- *			 that will be read is correct. If the rec is outside the buffer,
- *			 calculate the offset nearest a multiple of the buffer size,
- *			 NRECS. Use integer division to round down to nearest multiple.
- *			 lseek() to the start of the buffer, update buf_start, and reload.
- *			 For cases outside AND inside buffer, update cur_rec to the
- *			 correct position.
- *	   Note: When calling lseek() to prep for reading into the buffer, offset
- *			 is calculated to return to buffer at the nearest multiple of the
- *			 buffer size. E.g., if UID 600 is requested with NRECS set to 512,
- *			 lseek() will point to offset 512 and read records 512-1023.
+ *	  Input: lf, the open file
+ *			 rec, the index (based on UID) of the record requested
+ *	 Method: If rec is already in the buffer, only cur_rec moves. If the
+ *			 extent map shows the record lies entirely in a hole (the user
+ *			 never logged in), nothing is read and the next llf_read()
+ *			 returns a record of zeros; a record past the end of the file is
+ *			 an error, as a failed read would be. Otherwise buf_start is set
+ *			 to rec rounded down to a multiple of the window (NRECS unless
+ *			 configured) and ll_reload() loads the buffer from there with
+ *			 the configured backend, then cur_rec is set within it.
+ *	   Note: E.g., if UID 600 is requested with a window of 512, the buffer
+ *			 holds records 512-1023 and cur_rec is 88.
  */
-int ll_seek(int rec)
+int llf_seek(struct llfile *lf, int rec)
 {
-	//error was returned when ll_open was called, no file to seek
-	if (ll_fd == -1)
-		return -1;
+	int rv;
+
+	prof_enter("ll_seek");
+	rv = ll_seek_buf(lf, rec);
+	prof_exit();
+
+	return rv;
+}
+
+/*
+ *	ll_seek_buf()
+ *	Purpose: body of llf_seek(), kept separate so llf_seek() can wrap it in
+ *			 a profiler span without tracking every return path
+ */
+static int ll_seek_buf(struct llfile *lf, int rec)
+{
+	lf->in_hole = 0;
+	ll_count(&prog.lookups, 1);
+	__atomic_store_n(&prog.rec, rec, __ATOMIC_RELAXED);
+
+	if (rec < lf->buf_start || rec > (lf->buf_start + lf->num_recs - 1))
+	{
+		//outside buffer: past the end, in a hole, or needs a read
+		if (lf->ext_ok && (off_t) ((rec + 1) * LLSIZE) > lf->ll_size)
+			return -1;
+
+		if (ll_hole(lf, rec))						//no I/O needed
+		{
+			ll_count(&prog.holes, 1);
+			lf->in_hole = 1;
+			lf->buf_start = rec + 1;				//next llf_read() reloads
+			lf->num_recs = 0;						//after this record
+			lf->cur_rec = 0;
+			return 0;
+		}
+
+		lf->buf_start = (rec / lf->nrecs) * lf->nrecs;	//ll_reload reads
+		lf->num_recs = 0;								//from buf_start
+
+		if (ll_reload(lf) <= rec - lf->buf_start)	//reload failed
+			return -1;
+	}
+
+	lf->cur_rec = rec - lf->buf_start;				//adjust cur_rec
+	return 0;
+}
+
+/*
+ *	llf_prefetch()
+ *	Purpose: start reading the buffers that upcoming llf_seek() calls will
+ *			 load, so the disk works on them while earlier records are used
+ *	  Input: lf, the open file
+ *			 recs, the records (UIDs) that will be asked for; the array is
+ *				overwritten, it is scratch space
+ *			 n, number of records
+ *	 Return: number of posix_fadvise() calls made
+ *	 Method: Map each record to the window llf_seek() would load for
+ *			 it, leaving out records in holes or past the end (they need no
+ *			 read) and the window already in the buffer. Sort and de-dup the
+ *			 windows and give each run of adjacent windows to one
+ *			 posix_fadvise(POSIX_FADV_WILLNEED), which queues the reads and
+ *			 returns without waiting for them.
+ */
+int llf_prefetch(struct llfile *lf, int *recs, int n)
+{
+	int i, w = 0, calls = 0;
+
+	prof_enter("ll_prefetch");
 
-	if (rec == cur_rec)										 //no seek needed
+	for (i = 0; i < n; i++)						//records -> windows
+	{
+		int rec = recs[i];
+
+		if (rec < 0 || ll_hole(lf, rec) ||
+			(lf->ext_ok && (off_t) ((rec + 1) * LLSIZE) > lf->ll_size))
+			continue;
+		if (lf->num_recs > 0 && rec / lf->nrecs == lf->buf_start / lf->nrecs)
+			continue;
+
+		recs[w++] = rec / lf->nrecs;
+	}
+
+	qsort(recs, w, sizeof(int), cmp_int);
+
+	for (i = 0; i < w; )						//one call per run
+	{
+		int first = recs[i], last = recs[i];
+
+		while (i < w && recs[i] <= last + 1)
+			last = recs[i++];
+
+		posix_fadvise(lf->ll_fd, (off_t) first * lf->nrecs * LLSIZE,
+					  (off_t) (last - first + 1) * lf->nrecs * LLSIZE,
+					  POSIX_FADV_WILLNEED);
+		calls++;
+	}
+
+	prof_exit();
+	return calls;
+}
+
+/*
+ *	cmp_int() - qsort() comparison for window numbers
+ */
+static int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *) a;
+	int y = *(const int *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	ll_count() - add to a running total, see ll_progress()
+ */
+static void ll_count(uint64_t *total, uint64_t n)
+{
+	__atomic_store_n(total, __atomic_load_n(total, __ATOMIC_RELAXED) + n,
+					 __ATOMIC_RELAXED);
+}
+
+/*
+ *	ll_hole()
+ *	Purpose: see if a record lies entirely inside a hole of the file
+ *	  Input: rec, the index (based on UID) of the record
+ *	 Return: 1 if no byte of the record is in a data extent, 0 otherwise
+ *			 (including when there is no extent map to consult)
+ *	 Method: Binary search for the first extent that ends after the start
+ *			 of the record. It is a hole if there is none, or if that extent
+ *			 starts at or after the end of the record.
+ */
+static int ll_hole(struct llfile *lf, int rec)
+{
+	off_t start = (off_t) rec * LLSIZE;
+	int lo = 0, hi = lf->num_ext;
+
+	if (!lf->ext_ok)
 		return 0;
 
-	if (rec < buf_start || rec > (buf_start + num_recs - 1)) //outside buffer
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if (lf->ext[2 * mid + 1] <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo == lf->num_ext || lf->ext[2 * lo] >= start + (off_t) LLSIZE;
+}
+
+/*
+ *	ll_extents()
+ *	Purpose: list the data extents of an open file
+ *	  Input: fd, the open file
+ *			 size, the file size, from fstat()
+ *			 extp, where to store a malloc()ed array of [start, end) byte
+ *				pairs, in file order; the caller frees it
+ *			 max, most extents wanted, 0 for no limit
+ *	 Return: the number of extents, or -1 if the filesystem cannot report
+ *			 them, memory runs out, or there are more than max
+ *	 Method: Walk the file with lseek(SEEK_DATA) and lseek(SEEK_HOLE),
+ *			 storing each [data, hole) pair. Moves the file offset.
+ */
+int ll_extents(int fd, off_t size, off_t **extp, int max)
+{
+	off_t *ext = NULL;
+	off_t data, hole = 0;
+	int n = 0, cap = 0;
+
+	while (hole < size)
 	{
-		off_t offset = (rec / NRECS) * NRECS * LLSIZE;		 //calculate offset
+		if ( (data = lseek(fd, hole, SEEK_DATA)) == -1 )
+		{
+			if (errno == ENXIO)					//ENXIO: only a hole is left
+				break;
+			n = -1;
+		}
+		else if ( (hole = lseek(fd, data, SEEK_HOLE)) == -1 )
+			n = -1;
+		else if (max > 0 && n == max)			//too fragmented to pay off
+			n = -1;
+		else if (n == cap)						//grow the table
+		{
+			off_t *bigger = realloc(ext, 2 * (cap + 16) * sizeof(off_t));
 
-		if ( lseek(ll_fd, offset, SEEK_SET) == -1 )
+			if (bigger == NULL)
+				n = -1;
+			else
+			{
+				ext = bigger;
+				cap += 16;
+			}
+		}
+
+		if (n == -1)							//any of the errors above
+		{
+			free(ext);
 			return -1;
+		}
+
+		ext[2 * n] = data;
+		ext[2 * n + 1] = hole;
+		n++;
+	}
+
+	*extp = ext;
+	return n;
+}
+
+/*
+ *	ll_write_recs()
+ *	Purpose: write a set of records to a lastlog file with few system calls
+ *	  Input: fd, the file, open for writing
+ *			 recs, the record numbers (UIDs), ascending with no repeats
+ *			 lls, lls[i] is the record to store at recs[i]
+ *			 n, number of records
+ *	 Return: n on success, -1 on a write error (errno is set)
+ *	 Method: Records with consecutive numbers go out together in one
+ *			 pwritev(), one iovec each, up to IOV_MAX at a time. Nothing is
+ *			 written between runs, so the gaps keep whatever they held, and
+ *			 stay holes in a sparse file.
+ */
+int ll_write_recs(int fd, const int *recs, struct lastlog **lls, int n)
+{
+	struct iovec iov[IOV_MAX];
+	ssize_t want;
+	int i = 0, k;
 
-		buf_start = (rec / NRECS) * NRECS;
+	prof_enter("ll_write_recs");
 
-		if (ll_reload() <= 0)								 //reload failed
+	while (i < n)
+	{
+		for (k = 0; k < IOV_MAX && i + k < n &&
+					recs[i + k] == recs[i] + k; k++)
+		{
+			iov[k].iov_base = lls[i + k];
+			iov[k].iov_len = LLSIZE;
+		}
+
+		want = k * LLSIZE;
+		if (pwritev(fd, iov, k, (off_t) recs[i] * LLSIZE) != want)
+		{
+			prof_exit();
 			return -1;
+		}
+
+		i += k;
 	}
 
-	cur_rec = rec - buf_start;								 //adjust cur_rec
-	return 0;
+	prof_exit();
+	return n;
 }
 
 /*
- *	ll_reload()
+ *	ll_map_extents()
+ *	Purpose: build the table of data extents for the open file
+ *	 Method: ll_extents(), done once per llf_open(); a sparse lastlog with
+ *			 thousands of users usually has only a handful of extents. If
+ *			 the filesystem does not support SEEK_DATA, memory runs out, or
+ *			 the file is so fragmented that MAX_EXT extents do not cover it
+ *			 (the walk would then cost more than the reads it saves), ext_ok
+ *			 stays 0 and every record is read as before.
+ *	   Note: The map is a snapshot. A login recorded into a hole after
+ *			 llf_open() is seen as "never logged in", the same answer a read
+ *			 made just before that login would have given.
+ */
+static void ll_map_extents(struct llfile *lf)
+{
+	struct stat st;
+
+	lf->ext_ok = 0;
+	lf->num_ext = 0;
+
+	if (lf->ll_fd == -1 || fstat(lf->ll_fd, &st) == -1)
+		return;
+
+	lf->ll_size = st.st_size;
+	__atomic_store_n(&prog.size, st.st_size, __ATOMIC_RELAXED);
+	lf->fd_rec = -1;							//lseek moves the offset
+	lf->num_ext = ll_extents(lf->ll_fd, lf->ll_size, &lf->ext, MAX_EXT);
+	lf->ext_ok = (lf->num_ext != -1);
+}
+
+/*
+ *	llf_read()
  *	Purpose: read the lastlog record located at cur_rec in the current buffer
  *	 Return: pointer to the lastlog record located in the buffer
  *	 Method: When called for the first time (both buf_start & num_recs are 0),
@@ -87,64 +635,101 @@ int ll_seek(int rec)
  *			 if we have reached the end of the buffer and if more recs exist.
  *			 Otherwise, the requested cur_rec is in the buffer, so access it
  *			 and return a pointer. Increment cur_rec so sequential records do
- *			 not need seeking.
+ *			 not need seeking. After llf_seek() lands in a hole, return the
+ *			 zero record; the buffer was already set to reload after it.
  *	   Note: copied (with minor modifications), from utmplib.c file. Provided
  *			 in assignment files, also used in lecture 02.
  */
-struct lastlog *ll_read()
+struct lastlog *llf_read(struct llfile *lf)
 {
-	//error was returned when ll_open was called
-	if (ll_fd == -1)
-		return LL_NULL;
-
-	//first time being called, load up buffer
-	if (buf_start == 0 && num_recs == 0)
-		ll_reload();
+	//llf_seek found the record in a hole, so there is nothing to read
+	if (lf->in_hole)
+	{
+		lf->in_hole = 0;
+		return &zero_rec;
+	}
 
-	//at the end of the buffer, and reload doesn't return any more
-	if(cur_rec == num_recs && ll_reload() == 0)
-		return LL_NULL;
+	//at the end of the buffer (or first call), and reload gets no more
+	if (lf->cur_rec == lf->num_recs)
+	{
+		lf->buf_start += lf->num_recs;		//next buffer follows this one
+		if (ll_reload(lf) <= 0)
+			return LL_NULL;
+	}
 
-	//store the pointer to the cur_rec and increment cur_rec for next ll_read
-	struct lastlog *llp = (struct lastlog *) &llbuf[cur_rec * LLSIZE];
-	cur_rec++;
+	//store the pointer to the cur_rec and increment cur_rec for next read
+	struct lastlog *llp = (struct lastlog *) &lf->llbuf[lf->cur_rec * LLSIZE];
+	lf->cur_rec++;
 
 	return llp;
 }
 
 /*
  *	ll_reload()
- *	Purpose: read in NRECS to buffer
+ *	Purpose: load a window of records to the buffer, starting at record
+ *			 buf_start
+ *	 Method: By backend. LL_READ lseek()s only when the file offset is not
+ *			 already at buf_start, so sequential reloads cost a single
+ *			 read(). LL_PREAD is one pread(), with no offset to track.
+ *			 LL_MMAP copies nothing: the buffer is pointed into the mapping.
  *	   Note: copied (with minor modifications), from utmplib.c file. Provided
  *			 in assignment files, also used in lecture 02.
  */
-static int ll_reload()
+static int ll_reload(struct llfile *lf)
 {
-	//where to read from is set first by ll_open, then by ll_seek
-	int amt_read = read(ll_fd, llbuf, (NRECS*LLSIZE));
+	//where to read from is set by llf_open, llf_seek, and llf_read
+	off_t offset = (off_t) lf->buf_start * LLSIZE;
+	off_t want = (off_t) lf->nrecs * LLSIZE;
+	ssize_t amt_read = -1;
+
+	prof_enter("ll_reload");
+	if (lf->backend == LL_MMAP)
+	{
+		amt_read = (offset >= lf->ll_size) ? 0 : lf->ll_size - offset;
+		if (amt_read > want)
+			amt_read = want;
+		lf->llbuf = lf->map + ((offset < lf->ll_size) ? offset : 0);
+	}
+	else if (lf->backend == LL_PREAD)
+		amt_read = pread(lf->ll_fd, lf->buf, want, offset);
+	else if (lf->fd_rec == lf->buf_start ||
+			 lseek(lf->ll_fd, offset, SEEK_SET) != -1)
+		amt_read = read(lf->ll_fd, lf->buf, want);
+	prof_exit();
 
-	if (amt_read < 0)
-		amt_read = -1;
+	lf->cur_rec = 0;
 
-	num_recs = amt_read/LLSIZE;
-	cur_rec = 0;
+	if (amt_read < 0)					//leave an empty buffer on error
+	{
+		lf->num_recs = 0;
+		lf->fd_rec = -1;
+		return -1;
+	}
 
-	return num_recs;
+	lf->num_recs = amt_read/LLSIZE;
+	ll_count(&prog.bytes, amt_read);
+	lf->fd_rec = (lf->backend == LL_READ && amt_read % LLSIZE == 0) ?
+				 lf->buf_start + lf->num_recs : -1;
+
+	return lf->num_recs;
 }
 
 /*
- *	ll_close()
- *	Purpose: close the open file
+ *	llf_close()
+ *	Purpose: close the open file and free the handle
+ *	 Return: the result of close(), -1 on error
  *	   Note: copied (with minor modifications), from utmplib.c file. Provided
  *			 in assignment files, also used in lecture 02.
  */
-int ll_close()
+int llf_close(struct llfile *lf)
 {
-	int value = 0;
+	int value = close(lf->ll_fd);
 
-	//if there is no file open, do not close it
-	if (ll_fd != -1)
-		value = close(ll_fd);
+	if (lf->map != NULL)
+		munmap(lf->map, lf->ll_size);
+	free(lf->ext);
+	mem_free(lf->buf);
+	free(lf);
 
 	return value;
 }
@@ -2,7 +2,64 @@
  * lllib.h - header file with functions located in lllib.c
  */
 
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * ll_field - a length-bounded view of a fixed-size lastlog string field,
+ * which may fill the field completely and so lack a terminating '\0'
+ */
+struct ll_field {
+	const char *str;				//first char of the field
+	int len;						//chars before the first '\0', or size
+};
+
+#define LL_CONF_FILE	"/etc/alastlog.conf"	//written by --autotune
+
+#define LL_READ			0			//lseek() and read() a window at a time
+#define LL_PREAD		1			//pread() a window at a time
+#define LL_MMAP			2			//map the file, no copies
+#define LL_BACKENDS		3
+
+/*
+ * ll_conf - how llf_open() reads a lastlog, tuned by alastlog --autotune
+ */
+struct ll_conf {
+	int window;						//records per buffer load
+	int backend;					//LL_READ, LL_PREAD or LL_MMAP
+	int threads;					//alastlog's --threads when not given
+};
+
+/*
+ * ll_progress - running totals of the reading lllib has done, over every
+ * file opened, for progress reports taken from another thread
+ */
+struct ll_progress {
+	uint64_t lookups;				//llf_seek() calls
+	uint64_t holes;					//of those, answered from the extent map
+	uint64_t bytes;					//bytes loaded into buffers
+	uint64_t rec;					//record asked for by the last llf_seek()
+	uint64_t size;					//size of the last file opened
+};
+
+struct llfile;						//an open lastlog, defined in lllib.c
+
+struct ll_field ll_field(const char *, int);
+void ll_conf_get(struct ll_conf *);
+void ll_conf_set(const struct ll_conf *);
+int ll_conf_load(char *);
+int ll_conf_save(char *, const struct ll_conf *);
+const char *ll_backend_name(int);
+void ll_progress(struct ll_progress *);
+int ll_extents(int, off_t, off_t **, int);
 int ll_open(char *);
 int ll_seek(int);
 struct lastlog *ll_read();
+int ll_prefetch(int *, int);
+int ll_write_recs(int, const int *, struct lastlog **, int);
 int ll_close();
+struct llfile *llf_open(char *);
+int llf_seek(struct llfile *, int);
+struct lastlog *llf_read(struct llfile *);
+int llf_prefetch(struct llfile *, int *, int);
+int llf_close(struct llfile *);
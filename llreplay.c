@@ -0,0 +1,360 @@
+#define _DEFAULT_SOURCE				//for strsep()
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * llreplay - replays the queries recorded by alastlog --trace-queries against
+ * a chosen lastlog and passwd file, some number at a time, and reports the
+ * throughput and latency, next to the latency recorded in production.
+ */
+
+#define NS_IN_SEC	1000000000L
+#define MAX_ARGS	64				//args kept from one trace line
+#define MAX_JOBS	256				//most queries run at once
+
+/*
+ * query - one traced invocation, ready to run
+ */
+struct query {
+	char *argv[MAX_ARGS + 8];		//alastlog, its args, -f, --passwd, NULL
+	long traced_ns;					//time it took when it was traced
+	int traced_rv;					//exit status it had then
+};
+
+static struct query *queries;		//the replayable queries, in trace order
+static int num_queries;
+static int skipped;					//trace lines that were not replayed
+
+int cmp_long(const void *, const void *);
+int load_trace(char *, char *, char *, char *);
+long now_ns();
+void percentiles(char *, long *, int);
+pid_t start_query(struct query *);
+char *unescape(char *);
+
+/*
+ * main()
+ * Method: "llreplay [-j JOBS] [-n PASSES] [-b ALASTLOG] -f LASTLOG -p PASSWD
+ *		   TRACE". Each traced query is run PASSES times, in trace order,
+ *		   with up to JOBS of them running at once to play the concurrency
+ *		   of a busy host. Every run reads LASTLOG and, without NSS, PASSWD;
+ *		   the -f and passwd options of the trace are replaced. Output goes
+ *		   to /dev/null, so terminal speed is not part of the result.
+ * Return: 0 on success, 1 on bad usage or if the trace cannot be read.
+ */
+int main(int ac, char *av[])
+{
+	char *binary = "./alastlog", *lastlog = NULL, *passwd = NULL;
+	int jobs = 1, passes = 1, opt;
+
+	while ((opt = getopt(ac, av, "b:f:j:n:p:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': binary = optarg; break;
+			case 'f': lastlog = optarg; break;
+			case 'j': jobs = atoi(optarg); break;
+			case 'n': passes = atoi(optarg); break;
+			case 'p': passwd = optarg; break;
+			default: lastlog = NULL; optind = ac; break;
+		}
+	}
+
+	if (optind != ac - 1 || lastlog == NULL || passwd == NULL || jobs < 1 ||
+		jobs > MAX_JOBS || passes < 1)
+	{
+		fprintf(stderr, "Usage: llreplay [-j JOBS] [-n PASSES] [-b ALASTLOG] "
+				"-f LASTLOG -p PASSWD TRACE\n");
+		exit(1);
+	}
+
+	if (load_trace(av[optind], binary, lastlog, passwd) == -1)
+	{
+		perror(av[optind]);
+		exit(1);
+	}
+
+	if (num_queries == 0)
+	{
+		fprintf(stderr, "llreplay: no replayable queries in %s\n", av[optind]);
+		exit(1);
+	}
+
+	int total = num_queries * passes;
+	long *ns = malloc(total * sizeof(long));
+	long *traced = malloc(num_queries * sizeof(long));
+	pid_t pids[MAX_JOBS];
+	long starts[MAX_JOBS];
+	int slot_q[MAX_JOBS];					//query each slot is running
+	int next = 0, done = 0, running = 0, failed = 0, changed = 0;
+	int status, i;
+
+	if (ns == NULL || traced == NULL)
+	{
+		perror("llreplay");
+		exit(1);
+	}
+
+	memset(pids, 0, sizeof(pids));
+	long t0 = now_ns();
+
+	while (done < total)
+	{
+		if (running < jobs && next < total)		//start another
+		{
+			for (i = 0; pids[i] != 0; i++)		//a free slot
+				;
+			starts[i] = now_ns();
+			slot_q[i] = next % num_queries;
+			if ( (pids[i] = start_query(&queries[slot_q[i]])) == -1 )
+			{
+				perror("fork");
+				exit(1);
+			}
+			next++;
+			running++;
+			continue;
+		}
+
+		pid_t pid = wait(&status);				//wait for one to end
+
+		for (i = 0; i < jobs && pids[i] != pid; i++)
+			;
+		if (pid == -1 || i == jobs)
+			continue;
+
+		ns[done++] = now_ns() - starts[i];
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+		if (!WIFEXITED(status) ||
+			WEXITSTATUS(status) != (queries[slot_q[i]].traced_rv & 0xff))
+			changed++;						//not the traced outcome
+		pids[i] = 0;
+		running--;
+	}
+
+	long wall = now_ns() - t0;
+
+	for (i = 0; i < num_queries; i++)
+		traced[i] = queries[i].traced_ns;
+
+	printf("%d queries (%d skipped), %d passes, %d jobs: %d runs in %.3fs, "
+		   "%.1f/s, %d failed, %d unlike trace\n", num_queries, skipped,
+		   passes, jobs, total, (double) wall / NS_IN_SEC,
+		   total * (double) NS_IN_SEC / wall, failed, changed);
+	percentiles("replay", ns, total);
+	percentiles("traced", traced, num_queries);
+
+	free(ns);
+	free(traced);
+	return 0;
+}
+
+/*
+ *	cmp_long() - qsort() comparison for run times
+ */
+int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a;
+	long y = *(const long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	load_trace()
+ *	Purpose: read a --trace-queries file into queries
+ *	  Input: path, the trace
+ *			 binary, the alastlog to run
+ *			 lastlog, passwd, the files every query reads
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: Each line is "EPOCH\tMICROSECONDS\tSTATUS\tARGS...". The
+ *			 trace's own -f, --passwd, --no-nss, --profile and
+ *			 --trace-queries are dropped, and -f LASTLOG --passwd PASSWD
+ *			 are added. Only options known to leave files alone are
+ *			 kept (keep1, keep2, and --sink to stdout); a run with any
+ *			 other option is skipped, so options added later, which may
+ *			 write, are never replayed until they are listed here.
+ */
+int load_trace(char *path, char *binary, char *lastlog, char *passwd)
+{
+	static const char *drop2[] = {"-f", "--passwd", "--profile",
+								  "--trace-queries", NULL};
+	static const char *keep1[] = {"--progress", NULL};
+	static const char *keep2[] = {"-u", "-t", "--threads", "--host-match-file",
+								  "--tenant-map", "--memory-limit", "--sink",
+								  NULL};
+	FILE *fp = fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	int qcap = 0;
+
+	if (fp == NULL)
+		return -1;
+
+	while (getline(&line, &cap, fp) != -1)
+	{
+		char *rest, *field, *text = strdup(line);
+		struct query q;
+		int n = 0, argc = 1, drop = 0, value = 0, bad = 0, rv = 0, k;
+		int known, sink = 0;
+		long us = 0;
+
+		if (text == NULL)
+			return -1;
+		text[strcspn(text, "\n")] = '\0';
+		q.argv[0] = binary;
+
+		for (rest = text; (field = strsep(&rest, "\t")) != NULL; n++)
+		{
+			if (n == 1)
+				us = atol(field);
+			if (n == 2)
+				rv = atoi(field);
+			if (n < 3)
+				continue;
+
+			field = unescape(field);
+			if (drop)							//value of a dropped option
+			{
+				drop = 0;
+				continue;
+			}
+			if (value)							//value of a kept option
+			{
+				char *path = strchr(field, ':');
+
+				bad |= sink && path != NULL && strcmp(path, ":-") != 0;
+				value = sink = 0;
+				if (argc < MAX_ARGS)
+					q.argv[argc++] = field;
+				continue;
+			}
+			for (k = 0; drop2[k] != NULL; k++)
+				drop |= strcmp(field, drop2[k]) == 0;
+			if (drop || strcmp(field, "--no-nss") == 0)
+				continue;
+
+			known = 0;
+			for (k = 0; keep2[k] != NULL; k++)
+				value |= strcmp(field, keep2[k]) == 0;
+			for (k = 0; keep1[k] != NULL; k++)
+				known |= strcmp(field, keep1[k]) == 0;
+			sink = strcmp(field, "--sink") == 0;
+			bad |= !(known || value);			//not known to be read-only
+			if (argc < MAX_ARGS)
+				q.argv[argc++] = field;
+		}
+
+		if (bad || n < 3)
+		{
+			skipped++;
+			free(text);
+			continue;
+		}
+
+		q.argv[argc++] = "-f";
+		q.argv[argc++] = lastlog;
+		q.argv[argc++] = "--passwd";
+		q.argv[argc++] = passwd;
+		q.argv[argc] = NULL;
+		q.traced_ns = us * 1000;
+		q.traced_rv = rv;
+
+		if (num_queries == qcap)
+		{
+			qcap = 2 * qcap + 64;
+			if ( (queries = realloc(queries, qcap * sizeof(struct query)))
+				 == NULL )
+				return -1;
+		}
+		queries[num_queries++] = q;			//text stays, argv points in it
+	}
+
+	free(line);
+	fclose(fp);
+	return 0;
+}
+
+/*
+ *	now_ns() - monotonic clock reading, in nanoseconds
+ */
+long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/*
+ *	percentiles() - sort run times and print a line of mean and percentiles
+ */
+void percentiles(char *label, long *ns, int n)
+{
+	long total = 0;
+	int i;
+
+	qsort(ns, n, sizeof(long), cmp_long);
+	for (i = 0; i < n; i++)
+		total += ns[i];
+
+	printf("  %-7s mean %8.1fus  p50 %8.1fus  p90 %8.1fus  p99 %8.1fus  "
+		   "max %8.1fus\n", label, total / 1e3 / n, ns[n / 2] / 1e3,
+		   ns[n * 90 / 100] / 1e3, ns[n * 99 / 100] / 1e3, ns[n - 1] / 1e3);
+}
+
+/*
+ *	start_query()
+ *	Purpose: start one query, output to /dev/null
+ *	 Return: the child's pid, or -1 if fork() failed
+ */
+pid_t start_query(struct query *qp)
+{
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		int fd = open("/dev/null", O_WRONLY);
+
+		if (fd != -1)
+		{
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		execvp(qp->argv[0], qp->argv);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+/*
+ *	unescape()
+ *	Purpose: undo the \t, \n and \\ escapes of a trace field, in place
+ *	 Return: the field
+ */
+char *unescape(char *field)
+{
+	char *in = field, *out = field;
+
+	for (; *in != '\0'; in++)
+	{
+		if (*in == '\\' && in[1] != '\0')
+		{
+			in++;
+			*out++ = (*in == 't') ? '\t' : (*in == 'n') ? '\n' : *in;
+		}
+		else
+			*out++ = *in;
+	}
+	*out = '\0';
+
+	return field;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * llstart - end-to-end invocation time benchmark: runs a command (normally
+ * alastlog -u USER, as PAM and audit hooks do) many times, one after the
+ * other, and reports how long each run took from fork() to exit.
+ */
+
+#define NS_IN_SEC	1000000000L
+
+int cmp_long(const void *, const void *);
+long now_ns();
+long run_once(char **);
+
+/*
+ * main()
+ * Method: "llstart [-n RUNS] COMMAND [ARGS...]". The first run is a warm-up
+ *		   and not counted, so every counted run finds the binary and its
+ *		   libraries in the page cache. The command's output goes to
+ *		   /dev/null, so terminal speed is not part of the result.
+ * Return: 0 on success, 1 on bad usage or if a run fails.
+ */
+int main(int ac, char *av[])
+{
+	int runs = 200;
+	int i = 1;
+
+	if (ac > 2 && strcmp(av[1], "-n") == 0)
+	{
+		runs = atoi(av[2]);
+		i = 3;
+	}
+
+	if (i >= ac || runs < 1)
+	{
+		fprintf(stderr, "Usage: llstart [-n RUNS] COMMAND [ARGS...]\n");
+		exit(1);
+	}
+
+	long *ns = malloc(runs * sizeof(long));
+	long total = 0;
+	int r;
+
+	if (ns == NULL || run_once(&av[i]) == -1)			//warm-up run
+	{
+		perror(av[i]);
+		exit(1);
+	}
+
+	for (r = 0; r < runs; r++)
+	{
+		if ( (ns[r] = run_once(&av[i])) == -1 )
+		{
+			fprintf(stderr, "llstart: %s failed\n", av[i]);
+			exit(1);
+		}
+		total += ns[r];
+	}
+
+	qsort(ns, runs, sizeof(long), cmp_long);
+
+	for (r = i; r < ac; r++)
+		printf("%s%s", av[r], (r + 1 < ac) ? " " : "\n");
+	printf("  %d runs  mean %7.1fus  min %7.1fus  p50 %7.1fus  "
+		   "p99 %7.1fus\n", runs, total / 1e3 / runs, ns[0] / 1e3,
+		   ns[runs / 2] / 1e3, ns[runs * 99 / 100] / 1e3);
+
+	free(ns);
+	return 0;
+}
+
+/*
+ *	cmp_long() - qsort() comparison for run times
+ */
+int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a;
+	long y = *(const long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	now_ns() - monotonic clock reading, in nanoseconds
+ */
+long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/*
+ *	run_once()
+ *	Purpose: run the command once and time it
+ *	  Input: argv, the command and its args, NULL terminated
+ *	 Return: elapsed nanoseconds, or -1 if it could not be run or exited
+ *			 with a non-zero status
+ */
+long run_once(char **argv)
+{
+	long start = now_ns();
+	pid_t pid = fork();
+	int status;
+
+	if (pid == -1)
+		return -1;
+
+	if (pid == 0)
+	{
+		int fd = open("/dev/null", O_WRONLY);
+
+		if (fd != -1)
+			dup2(fd, STDOUT_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+		WEXITSTATUS(status) != 0)
+		return -1;
+
+	return now_ns() - start;
+}
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lastlog.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "lllib.h"
+
+/*
+ * llstorm - mixed reader/writer benchmark for lllib, simulating a login
+ * storm: writer processes update lastlog records at a target rate while
+ * reader processes run full alastlog-style scans and single -u lookups.
+ */
+
+#define LLSIZE		(sizeof(struct lastlog))
+#define MAX_SAMPLES	(1 << 18)		//latency samples kept per process
+#define CLUSTER		512				//UIDs in a clustered writer's hot set
+#define NS_IN_SEC	1000000000L
+
+struct lat {
+	long count;						//samples taken (may exceed MAX_SAMPLES)
+	long ns[MAX_SAMPLES];			//latency of each sample, in ns
+};
+
+struct slot {
+	struct lat lookup;				//reader -u lookups, or writer pwrite()s
+	long scans;						//full scans completed by a reader
+	long recs;						//records returned by ll_read()
+};
+
+static char *file = NULL;			//scratch lastlog, -f
+static int created = 0;				//make_file() made file, main() unlinks
+static int nuids = 100000;			//UID range in the file, -n
+static int writers = 4;				//writer processes, -w
+static int readers = 2;				//reader processes, -r
+static long rate = 1000;			//writes/s per writer, -R
+static int seconds = 5;				//length of the run, -d
+static int lookups = 100;			//-u lookups between scans, -l
+static int clustered = 0;			//writers use clustered UIDs, -c
+static char *backend = "read";		//lllib backend for readers, -b
+static int window = 0;				//lllib window in records, -W, 0 for
+									//the configured one
+
+int cmp_long(const void *, const void *);
+void fatal(char *);
+long now_ns();
+void make_file();
+long parse_num(char *);
+void report(char *, struct slot *, int, int);
+void run_reader(struct slot *, long);
+void run_writer(struct slot *, long, unsigned);
+void set_backend();
+
+/*
+ * main()
+ * Method: Parse "-X value" options, create the scratch file, then fork the
+ *		   writers and readers into slots of a shared anonymous mapping so
+ *		   the parent can collect their latencies after they exit.
+ * Return: 0 on success, exits 1 with a message to stderr on failure.
+ */
+int main(int ac, char *av[])
+{
+	int i;
+
+	for (i = 1; i < ac; i += 2)
+	{
+		if (av[i][0] != '-' || av[i][1] == '\0' || (i + 1) >= ac)
+			fatal(av[i]);
+
+		switch (av[i][1])
+		{
+			case 'f': file = av[i + 1];						break;
+			case 'n': nuids = parse_num(av[i + 1]);			break;
+			case 'w': writers = parse_num(av[i + 1]);		break;
+			case 'r': readers = parse_num(av[i + 1]);		break;
+			case 'R': rate = parse_num(av[i + 1]);			break;
+			case 'd': seconds = parse_num(av[i + 1]);		break;
+			case 'l': lookups = parse_num(av[i + 1]);		break;
+			case 'c': clustered = parse_num(av[i + 1]);		break;
+			case 'b': backend = av[i + 1];					break;
+			case 'W': window = parse_num(av[i + 1]);		break;
+			default:  fatal(av[i]);
+		}
+	}
+
+	if (nuids < 1 || seconds < 1 || writers + readers < 1 || window < 0)
+		fatal("-n/-d/-w/-r/-W");
+
+	set_backend();
+	make_file();
+
+	int nproc = writers + readers;
+	size_t len = nproc * sizeof(struct slot);
+	struct slot *slots = mmap(NULL, len, PROT_READ | PROT_WRITE,
+							  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (slots == MAP_FAILED)
+	{
+		perror("mmap");
+		unlink(file);
+		exit(1);
+	}
+
+	long deadline = now_ns() + seconds * NS_IN_SEC;
+
+	for (i = 0; i < nproc; i++)
+	{
+		pid_t pid = fork();
+
+		if (pid == -1)
+		{
+			perror("fork");
+			exit(1);
+		}
+		else if (pid == 0 && i < writers)
+		{
+			run_writer(&slots[i], deadline, (unsigned) i + 1);
+			_exit(0);
+		}
+		else if (pid == 0)
+		{
+			run_reader(&slots[i], deadline);
+			_exit(0);
+		}
+	}
+
+	while (wait(NULL) > 0)			//reap all children
+		;
+
+	struct ll_conf c;
+
+	ll_conf_get(&c);
+	printf("backend: %s, window %d, %d UIDs, %d s, %s writers\n",
+		   ll_backend_name(c.backend), c.window, nuids, seconds,
+		   clustered ? "clustered" : "random");
+	report("writer pwrite", slots, writers, 0);
+	report("reader lookup", slots + writers, readers, 1);
+
+	if (created)
+		unlink(file);					//scratch file from make_file()
+
+	return 0;
+}
+
+/*
+ *	cmp_long() - qsort() comparison for latency samples
+ */
+int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a;
+	long y = *(const long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	fatal() - print usage to stderr and exit
+ */
+void fatal(char *arg)
+{
+	fprintf(stderr, "llstorm: bad option or value: %s\n", arg);
+	fprintf(stderr, "Usage: llstorm [-f FILE] [-n UIDS] [-w WRITERS] "
+			"[-r READERS]\n\t[-R WRITES/S] [-d SECONDS] [-l LOOKUPS] "
+			"[-c 0|1]\n\t[-b read|pread|mmap] [-W WINDOW]\n");
+	exit(1);
+}
+
+/*
+ *	now_ns() - monotonic clock reading, in nanoseconds
+ */
+long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/*
+ *	make_file()
+ *	Purpose: create the scratch lastlog, sized for nuids records
+ *	 Method: ftruncate() only, so the file starts out as one big hole, like
+ *			 a lastlog on a host where few of the users have logged in yet.
+ *			 Without -f a temporary file is used. A -f FILE must not exist
+ *			 yet (O_EXCL), so an existing lastlog is never overwritten.
+ *			 main() unlinks the file once all the children have exited.
+ */
+void make_file()
+{
+	static char tmpl[] = "/tmp/llstorm.XXXXXX";
+	int fd;
+
+	if (file == NULL)
+	{
+		file = tmpl;
+		fd = mkstemp(file);
+	}
+	else
+		fd = open(file, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd == -1)
+	{
+		perror(file);
+		exit(1);
+	}
+
+	created = 1;
+	if (ftruncate(fd, (off_t) nuids * LLSIZE) == -1)
+	{
+		perror(file);
+		unlink(file);
+		exit(1);
+	}
+
+	close(fd);
+}
+
+/*
+ *	parse_num() - parse a non-negative option value, exit if invalid
+ */
+long parse_num(char *value)
+{
+	char *end = NULL;
+	long n = strtol(value, &end, 10);
+
+	if (end == value || *end != '\0' || n < 0)
+		fatal(value);
+
+	return n;
+}
+
+/*
+ *	report()
+ *	Purpose: merge the samples of n slots and print throughput and tail
+ *			 latency for them
+ *	  Input: label, name printed for this group of processes
+ *			 slots, first slot of the group
+ *			 n, number of slots in the group
+ *			 is_reader, also print scan throughput
+ */
+void report(char *label, struct slot *slots, int n, int is_reader)
+{
+	long total = 0, kept = 0, scans = 0, recs = 0;
+	int i;
+
+	if (n == 0)
+		return;
+
+	for (i = 0; i < n; i++)
+	{
+		total += slots[i].lookup.count;
+		kept += (slots[i].lookup.count < MAX_SAMPLES) ?
+				slots[i].lookup.count : MAX_SAMPLES;
+		scans += slots[i].scans;
+		recs += slots[i].recs;
+	}
+
+	long *all = malloc((kept + 1) * sizeof(long));
+	long k = 0;
+
+	if (all == NULL)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		long c = (slots[i].lookup.count < MAX_SAMPLES) ?
+				 slots[i].lookup.count : MAX_SAMPLES;
+		memcpy(all + k, slots[i].lookup.ns, c * sizeof(long));
+		k += c;
+	}
+
+	qsort(all, kept, sizeof(long), cmp_long);
+
+	printf("%-14s %8ld ops %10.0f ops/s", label, total,
+		   (double) total / seconds);
+	if (kept > 0)
+		printf("  p50 %7.1fus  p99 %7.1fus  p99.9 %7.1fus  max %7.1fus",
+			   all[kept / 2] / 1e3, all[kept * 99 / 100] / 1e3,
+			   all[kept * 999 / 1000] / 1e3, all[kept - 1] / 1e3);
+	printf("\n");
+
+	if (is_reader)
+		printf("%-14s %8ld scans %10.0f recs/s\n", "reader scan", scans,
+			   (double) recs / seconds);
+
+	free(all);
+}
+
+/*
+ *	run_reader()
+ *	Purpose: alternate full scans and -u lookups until the deadline
+ *	 Method: A scan is what alastlog does without -u, one ll_seek() and
+ *			 ll_read() per UID in order. A lookup is what alastlog -u does,
+ *			 a fresh ll_open(), one ll_seek() + ll_read(), and ll_close();
+ *			 each lookup is timed on its own.
+ */
+void run_reader(struct slot *sp, long deadline)
+{
+	unsigned seed = (unsigned) getpid();
+	int uid, i;
+
+	while (now_ns() < deadline)
+	{
+		if (ll_open(file) == -1)
+			return;
+
+		for (uid = 0; uid < nuids; uid++)
+			if (ll_seek(uid) == 0 && ll_read() != NULL)
+				sp->recs++;
+
+		ll_close();
+		sp->scans++;
+
+		for (i = 0; i < lookups && now_ns() < deadline; i++)
+		{
+			long start = now_ns();
+
+			ll_open(file);
+			if (ll_seek(rand_r(&seed) % nuids) == 0)
+				ll_read();
+			ll_close();
+
+			if (sp->lookup.count < MAX_SAMPLES)
+				sp->lookup.ns[sp->lookup.count] = now_ns() - start;
+			sp->lookup.count++;
+		}
+	}
+}
+
+/*
+ *	run_writer()
+ *	Purpose: update records at a fixed rate until the deadline
+ *	 Method: Each write is a pwrite() of one struct lastlog, the way login
+ *			 updates lastlog. Writes are paced against absolute deadlines so
+ *			 a slow write is followed by catch-up writes, as in a real storm.
+ *			 In clustered mode the UIDs come from a CLUSTER-wide window that
+ *			 moves once per second; otherwise they are uniform over nuids.
+ */
+void run_writer(struct slot *sp, long deadline, unsigned seed)
+{
+	struct lastlog rec;
+	long next = now_ns();
+	long step = (rate > 0) ? NS_IN_SEC / rate : 0;
+	long moved = next;
+	int base = rand_r(&seed) % nuids;
+	int fd = open(file, O_WRONLY);
+
+	if (fd == -1)
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	strncpy(rec.ll_line, "pts/0", sizeof(rec.ll_line));
+	snprintf(rec.ll_host, sizeof(rec.ll_host), "storm-%u", seed);
+
+	while ((next = next + step) < deadline)
+	{
+		struct timespec ts = { next / NS_IN_SEC, next % NS_IN_SEC };
+		int uid;
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		if (clustered && next - moved >= NS_IN_SEC)
+		{
+			base = rand_r(&seed) % nuids;
+			moved = next;
+		}
+
+		uid = clustered ? (base + rand_r(&seed) % CLUSTER) % nuids
+						: rand_r(&seed) % nuids;
+		rec.ll_time = time(NULL);
+
+		long start = now_ns();
+		if (pwrite(fd, &rec, LLSIZE, (off_t) uid * LLSIZE) != LLSIZE)
+			break;
+
+		if (sp->lookup.count < MAX_SAMPLES)
+			sp->lookup.ns[sp->lookup.count] = now_ns() - start;
+		sp->lookup.count++;
+	}
+
+	close(fd);
+}
+
+/*
+ *	set_backend()
+ *	Purpose: apply -b and -W to lllib before the readers open the file
+ *	 Method: The readers inherit the setting across fork(). An mmap reader
+ *			 maps the file as it is at open, so it sees writes made since
+ *			 through the shared mapping, the same as the other backends.
+ */
+void set_backend()
+{
+	struct ll_conf c;
+	int b;
+
+	ll_conf_get(&c);
+	for (b = 0; b < LL_BACKENDS && strcmp(backend, ll_backend_name(b)); b++)
+		;
+	if (b == LL_BACKENDS)
+		fatal(backend);
+	c.backend = b;
+	if (window != 0)
+		c.window = window;
+	ll_conf_set(&c);
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define MEM_HDR			16			//size header, keeps malloc()'s alignment
+
+static size_t limit;				//--memory-limit, 0 for none
+static size_t used;					//bytes held through mem_alloc()
+static size_t peak;					//most ever held at once
+
+static void mem_give(size_t);
+static int mem_take(size_t);
+
+/*
+ *	mem_set_limit()
+ *	Purpose: set the budget for every mem_alloc() from now on
+ *	  Input: bytes, the budget, 0 for none
+ */
+void mem_set_limit(size_t bytes)
+{
+	limit = bytes;
+}
+
+/*
+ *	mem_limit() - the budget, 0 if there is none
+ */
+size_t mem_limit()
+{
+	return limit;
+}
+
+/*
+ *	mem_avail() - bytes left in the budget, SIZE_MAX if there is none
+ */
+size_t mem_avail()
+{
+	size_t u = __atomic_load_n(&used, __ATOMIC_RELAXED);
+
+	if (limit == 0)
+		return SIZE_MAX;
+
+	return (u < limit) ? limit - u : 0;
+}
+
+/*
+ *	mem_peak() - most bytes held through mem_alloc() at any one time
+ */
+size_t mem_peak()
+{
+	return __atomic_load_n(&peak, __ATOMIC_RELAXED);
+}
+
+/*
+ *	mem_alloc()
+ *	Purpose: malloc(), counted against the budget
+ *	 Return: the memory, or NULL if it would go over the budget or malloc()
+ *			 failed (errno is ENOMEM either way)
+ *	 Method: The size is kept in a header before the block, so
+ *			 mem_realloc() and mem_free() need only the pointer. The count
+ *			 is an atomic, as render threads allocate too.
+ */
+void *mem_alloc(size_t n)
+{
+	char *p;
+
+	if (!mem_take(n))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ( (p = malloc(n + MEM_HDR)) == NULL )
+	{
+		mem_give(n);
+		return NULL;
+	}
+
+	*(size_t *) p = n;
+	return p + MEM_HDR;
+}
+
+/*
+ *	mem_calloc()
+ *	Purpose: calloc(), counted against the budget
+ *	 Return: zeroed memory for n items of size bytes, or NULL as
+ *			 mem_alloc(), also if n * size does not fit a size_t
+ */
+void *mem_calloc(size_t n, size_t size)
+{
+	void *p;
+
+	if (size != 0 && n > SIZE_MAX / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ( (p = mem_alloc(n * size)) != NULL )
+		memset(p, 0, n * size);
+
+	return p;
+}
+
+/*
+ *	mem_realloc()
+ *	Purpose: realloc(), counted against the budget
+ *	 Return: the memory, or NULL as mem_alloc(); the old block is then
+ *			 left as it was
+ */
+void *mem_realloc(void *ptr, size_t n)
+{
+	char *p = (ptr != NULL) ? (char *) ptr - MEM_HDR : NULL;
+	size_t old = (p != NULL) ? *(size_t *) p : 0;
+	char *bigger;
+
+	if (ptr == NULL)
+		return mem_alloc(n);
+
+	if (n > old && !mem_take(n - old))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ( (bigger = realloc(p, n + MEM_HDR)) == NULL )
+	{
+		if (n > old)
+			mem_give(n - old);
+		return NULL;
+	}
+
+	if (n < old)
+		mem_give(old - n);
+	*(size_t *) bigger = n;
+
+	return bigger + MEM_HDR;
+}
+
+/*
+ *	mem_free() - free() memory from mem_alloc(), NULL is ignored
+ */
+void mem_free(void *ptr)
+{
+	char *p;
+
+	if (ptr == NULL)
+		return;
+
+	p = (char *) ptr - MEM_HDR;
+	mem_give(*(size_t *) p);
+	free(p);
+}
+
+/*
+ *	mem_give() - return bytes to the budget
+ */
+static void mem_give(size_t n)
+{
+	__atomic_sub_fetch(&used, n, __ATOMIC_RELAXED);
+}
+
+/*
+ *	mem_take()
+ *	Purpose: count n more bytes, if the budget allows
+ *	 Return: 1 if counted, 0 if that would go over the limit
+ */
+static int mem_take(size_t n)
+{
+	size_t now = __atomic_add_fetch(&used, n, __ATOMIC_RELAXED);
+	size_t high = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+
+	if (limit != 0 && (now > limit || now < n))	//over, or wrapped
+	{
+		mem_give(n);
+		return 0;
+	}
+
+	while (now > high &&
+		   !__atomic_compare_exchange_n(&peak, &high, now, 0, __ATOMIC_RELAXED,
+										__ATOMIC_RELAXED))
+		;
+
+	return 1;
+}
@@ -0,0 +1,14 @@
+/*
+ * mem.h - header file with functions located in mem.c
+ */
+
+#include <stddef.h>
+
+void mem_set_limit(size_t);
+size_t mem_limit();
+size_t mem_avail();
+size_t mem_peak();
+void *mem_alloc(size_t);
+void *mem_calloc(size_t, size_t);
+void *mem_realloc(void *, size_t);
+void mem_free(void *);
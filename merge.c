@@ -0,0 +1,891 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <lastlog.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lllib.h"
+#include "mem.h"
+#include "merge.h"
+#include "mirror.h"
+#include "prof.h"
+
+#define LLSIZE			(sizeof(struct lastlog))
+#define MERGE_BLOCK		4096		//bytes hashed at a time
+#define MERGE_CHUNK		256			//blocks read per pread()
+#define READ_RECS		512			//records read per pread()
+#define STATE_EXT		".merge"	//merge state is PATH.merge
+#define STATE_MAGIC		"LLMERG2"	//first 8 bytes of the state file
+#define NO_OWNER		-1			//best.owner of a UID no source has
+#define NOT_DIRTY		-1			//best.dirty: nothing to write
+#define RECOMPUTE		-2			//best.dirty: ask every source again
+
+/*
+ * state_head - start of the state file; the sources, then the table
+ * entries, follow it. The merged lastlog's identity as the last run left
+ * it says if the table still describes that file.
+ */
+struct state_head {
+	char magic[8];					//STATE_MAGIC
+	uint64_t nsrc;					//sources
+	uint64_t nbest;					//table entries
+	uint64_t dst_size;				//merged lastlog's size
+	uint64_t dst_mtime_ns;			//its modification time
+	uint64_t dst_ino;				//its inode
+};
+
+/*
+ * src_id - a source's identity as of the last run, followed in the state
+ * file by its path (path_len bytes) and nblocks block hashes
+ */
+struct src_id {
+	uint64_t size;					//file size
+	uint64_t mtime_ns;				//modification time
+	uint64_t ino;					//inode
+	uint64_t nblocks;				//MERGE_BLOCK blocks hashed
+	uint64_t path_len;				//bytes of path, no '\0'
+};
+
+/*
+ * source - one host's lastlog, as listed for this run or the last one
+ */
+struct source {
+	char *path;
+	struct src_id id;
+	uint64_t *hash;					//id.nblocks block hashes
+	int was;						//index in the last run, -1 if new
+};
+
+/*
+ * best - the latest login of one UID over all sources, and which source
+ * it came from; a slot of the open addressing table
+ */
+struct best {
+	int32_t uid;					//-1 for an empty slot
+	int32_t time;					//ll_time of the latest login
+	int32_t owner;					//source index, or NO_OWNER
+	int32_t dirty;					//index in dirty, NOT_DIRTY or RECOMPUTE
+};
+
+/*
+ * dirty_rec - a record to write to the merged lastlog
+ */
+struct dirty_rec {
+	int uid;
+	struct lastlog ll;
+};
+
+/*
+ * merge_stats - what a run did, for the summary line
+ */
+struct merge_stats {
+	int unchanged;					//sources skipped on identity alone
+	long blocks;					//blocks in changed sources
+	long rescanned;					//of those, blocks whose records were read
+	int recomputed;					//UIDs whose latest source went back
+	int written;					//records written to the merged lastlog
+};
+
+static struct source *srcs;			//this run's sources, in list order
+static int num_srcs;
+static struct source *olds;			//last run's sources
+static int num_olds;
+static struct best *table;			//the per-UID latest logins
+static size_t tab_cap;				//slots, a power of two
+static size_t tab_used;				//slots holding a UID
+static struct dirty_rec *dirty;		//records to write
+static int num_dirty;
+static int cap_dirty;
+static struct merge_stats stats;
+
+int apply_record(int, int, struct lastlog *);
+int cmp_dirty(const void *, const void *);
+int cmp_int(const void *, const void *);
+int cmp_path(const void *, const void *);
+struct best *find_best(int, int);
+int hash_source(int, struct source *, off_t);
+int load_state(char *, struct stat *);
+int mark_dirty(struct best *, int, struct lastlog *);
+int match_sources();
+int read_list(char *);
+int read_recs(int, long, long, struct lastlog *);
+int recompute();
+int save_state(char *, struct stat *);
+int scan_source(int);
+int write_merged(char *, int);
+
+/*
+ *	merge_files()
+ *	Purpose: keep a lastlog of each UID's latest login over a fleet of
+ *			 hosts' lastlog files, reading only what changed since last run
+ *	  Input: list, a file naming one host lastlog per line
+ *			 dst, the merged lastlog, created if it does not exist
+ *	 Output: a summary line of sources skipped, blocks read and records
+ *			 written
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: dst.merge holds, from the last run, each source's size, mtime,
+ *			 inode and a hash per MERGE_BLOCK block, and a table of every
+ *			 UID's latest login time and the source it came from. A source
+ *			 whose identity is unchanged is not read at all. A changed one
+ *			 is hashed (data extents only) and only the records in blocks
+ *			 whose hash changed are compared with the table. A later login
+ *			 wins; if the source holding a UID's latest login now has an
+ *			 older one (the record was reset, the file truncated, or the
+ *			 host left the list), that UID is asked of every source again.
+ *			 The changed records are written to dst with ll_write_recs(),
+ *			 then the new state replaces the old one.
+ *	   Note: Nothing is written until every source has been read, so a run
+ *			 that fails leaves dst and its state as they were. Without a
+ *			 usable state file, or if dst is missing or is not the file the
+ *			 last run wrote (its size, mtime and inode are in the state),
+ *			 dst is emptied and started over from every source.
+ */
+int merge_files(char *list, char *dst)
+{
+	char spath[PATH_MAX];
+	struct stat st;
+	int fresh, i, rv = 0;
+
+	snprintf(spath, sizeof(spath), "%s%s", dst, STATE_EXT);
+	memset(&stats, 0, sizeof(stats));
+
+	if (read_list(list) == -1)
+	{
+		perror(list);
+		return -1;
+	}
+
+	prof_enter("merge_files");
+	fresh = (stat(dst, &st) == -1 || load_state(spath, &st) == 0);
+
+	if (match_sources() == -1)
+		rv = -1;
+
+	for (i = 0; i < num_srcs && rv == 0; i++)
+		rv = scan_source(i);
+
+	if (rv == 0)
+		rv = recompute();
+
+	if (rv == -1)
+		perror("merge");
+	else if ( (rv = write_merged(dst, fresh)) == 0 &&
+			  (stat(dst, &st) == -1 || (rv = save_state(spath, &st)) == -1) )
+	{
+		perror(spath);
+		rv = -1;
+	}
+
+	if (rv == 0)
+		printf("merge: %d sources, %d unchanged, %ld of %ld blocks read, "
+			   "%d records written, %d recomputed\n", num_srcs,
+			   stats.unchanged, stats.rescanned, stats.blocks, stats.written,
+			   stats.recomputed);
+
+	prof_exit();
+	return rv;
+}
+
+/*
+ *	apply_record()
+ *	Purpose: compare a source's current record for a UID with the table
+ *	  Input: src, index of the source
+ *			 uid, the record number
+ *			 lp, the record
+ *	 Return: 0 on success, -1 if memory ran out
+ *	 Method: A later login takes the UID. The same time from the owner may
+ *			 still bring a new line or host, so it is written again. An
+ *			 older one from the owner means the latest login is gone from
+ *			 that source, so the UID is marked for recompute().
+ */
+int apply_record(int src, int uid, struct lastlog *lp)
+{
+	struct best *bp = find_best(uid, lp->ll_time != 0);
+
+	if (bp == NULL)
+		return (lp->ll_time != 0) ? -1 : 0;	//0: never logged in, not kept
+	if (bp->dirty == RECOMPUTE)
+		return 0;
+
+	if (lp->ll_time > bp->time)
+	{
+		bp->time = lp->ll_time;
+		bp->owner = src;
+		return mark_dirty(bp, uid, lp);
+	}
+
+	if (bp->owner != src)
+		return 0;
+	if (lp->ll_time < bp->time)
+	{
+		if (bp->dirty >= 0)
+			dirty[bp->dirty].uid = -1;		//queued record is void now
+		bp->dirty = RECOMPUTE;
+		return 0;
+	}
+
+	return mark_dirty(bp, uid, lp);
+}
+
+/*
+ *	cmp_dirty() - qsort() comparison for dirty records, by UID
+ */
+int cmp_dirty(const void *a, const void *b)
+{
+	int x = ((const struct dirty_rec *) a)->uid;
+	int y = ((const struct dirty_rec *) b)->uid;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	cmp_int() - qsort() comparison for UIDs
+ */
+int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *) a;
+	int y = *(const int *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	cmp_path() - qsort()/bsearch() comparison for last run's sources, by path
+ */
+int cmp_path(const void *a, const void *b)
+{
+	return strcmp(((const struct source *) a)->path,
+				  ((const struct source *) b)->path);
+}
+
+/*
+ *	find_best()
+ *	Purpose: find a UID in the table, optionally adding it
+ *	  Input: uid, the UID
+ *			 add, nonzero to add the UID if it is not there
+ *	 Return: the slot, or NULL if it is not there (or memory ran out)
+ *	 Method: Linear probing, kept at most half full, so a UID usually
+ *			 costs one cache line. Growing moves every slot, so a pointer
+ *			 is only good until the next call that adds.
+ */
+struct best *find_best(int uid, int add)
+{
+	size_t i, mask;
+
+	if (add && 2 * (tab_used + 1) > tab_cap)		//grow, rehash
+	{
+		struct best *old = table;
+		size_t old_cap = tab_cap, k;
+
+		tab_cap = (tab_cap == 0) ? 1024 : 2 * tab_cap;
+		if ( (table = mem_alloc(tab_cap * sizeof(struct best))) == NULL )
+		{
+			table = old;
+			tab_cap = old_cap;
+			return NULL;
+		}
+		memset(table, 0xff, tab_cap * sizeof(struct best));	//uid -1
+
+		for (k = 0; k < old_cap; k++)
+		{
+			if (old[k].uid == -1)
+				continue;
+			for (i = (old[k].uid * 0x9e3779b1u) & (tab_cap - 1);
+				 table[i].uid != -1; i = (i + 1) & (tab_cap - 1))
+				;
+			table[i] = old[k];
+		}
+		mem_free(old);
+	}
+
+	if (tab_cap == 0)
+		return NULL;
+
+	mask = tab_cap - 1;
+	for (i = (uid * 0x9e3779b1u) & mask; table[i].uid != -1; i = (i + 1) & mask)
+		if (table[i].uid == uid)
+			return &table[i];
+
+	if (!add)
+		return NULL;
+
+	table[i].uid = uid;
+	table[i].time = 0;
+	table[i].owner = NO_OWNER;
+	table[i].dirty = NOT_DIRTY;
+	tab_used++;
+
+	return &table[i];
+}
+
+/*
+ *	hash_source()
+ *	Purpose: hash every block of a source, reading only its data extents
+ *	  Input: fd, the source, open for reading
+ *			 sp, the source; sp->hash is filled in, holes stay HOLE_HASH
+ *			 size, its size
+ *	 Return: 0 on success, -1 on a read error or if memory ran out
+ */
+int hash_source(int fd, struct source *sp, off_t size)
+{
+	static unsigned char buf[MERGE_CHUNK * MERGE_BLOCK];
+	off_t *ext = NULL, whole[2] = { 0, size };
+	int n, i;
+
+	if ( (n = ll_extents(fd, size, &ext, 0)) == -1 )
+	{
+		n = 1;									//no SEEK_DATA: all data
+		free(ext);
+		ext = NULL;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		off_t end = ext ? ext[2 * i + 1] : whole[1];
+		off_t pos = ((ext ? ext[2 * i] : whole[0]) / MERGE_BLOCK) *
+					MERGE_BLOCK;
+
+		while (pos < end)
+		{
+			ssize_t amt = pread(fd, buf, sizeof(buf), pos), off;
+
+			if (amt <= 0)
+			{
+				free(ext);
+				return (amt == 0) ? 0 : -1;
+			}
+
+			for (off = 0; off < amt && pos + off < end; off += MERGE_BLOCK)
+				sp->hash[(pos + off) / MERGE_BLOCK] =
+					block_hash(buf + off, (amt - off < MERGE_BLOCK) ?
+										  amt - off : MERGE_BLOCK);
+			pos += amt;
+		}
+	}
+
+	free(ext);
+	return 0;
+}
+
+/*
+ *	load_state()
+ *	Purpose: read the sources and table left by the last run
+ *	  Input: path, the state file
+ *			 dst_st, the merged lastlog's current stat
+ *	 Return: 1 if a state was loaded, 0 if there is none, it is not
+ *			 usable, or it was saved for another merged lastlog than
+ *			 dst_st's (olds and table are then empty)
+ */
+int load_state(char *path, struct stat *dst_st)
+{
+	struct state_head h;
+	struct best b;
+	FILE *fp = fopen(path, "r");
+	uint64_t i;
+	int ok = 1;
+
+	if (fp == NULL)
+		return 0;
+
+	if (fread(&h, sizeof(h), 1, fp) != 1 ||
+		memcmp(h.magic, STATE_MAGIC, sizeof(h.magic)) != 0 ||
+		h.dst_size != (uint64_t) dst_st->st_size ||
+		h.dst_ino != dst_st->st_ino ||
+		h.dst_mtime_ns != (uint64_t) dst_st->st_mtim.tv_sec * 1000000000ULL +
+						  dst_st->st_mtim.tv_nsec ||
+		h.nsrc > INT_MAX ||
+		(olds = calloc(h.nsrc + 1, sizeof(struct source))) == NULL)
+		ok = 0;
+
+	for (i = 0; ok && i < h.nsrc; i++)
+	{
+		struct source *sp = &olds[num_olds];
+
+		if (fread(&sp->id, sizeof(sp->id), 1, fp) != 1 ||
+			sp->id.path_len >= PATH_MAX ||
+			(sp->path = calloc(sp->id.path_len + 1, 1)) == NULL ||
+			fread(sp->path, 1, sp->id.path_len, fp) != sp->id.path_len ||
+			(sp->hash = mem_alloc((sp->id.nblocks + 1) * sizeof(uint64_t)))
+				== NULL ||
+			fread(sp->hash, sizeof(uint64_t), sp->id.nblocks, fp) !=
+				sp->id.nblocks)
+		{
+			free(sp->path);
+			mem_free(sp->hash);
+			ok = 0;
+			break;
+		}
+		num_olds++;
+	}
+
+	for (i = 0; ok && i < h.nbest; i++)
+	{
+		struct best *bp;
+
+		if (fread(&b, sizeof(b), 1, fp) != 1 || b.uid < 0 ||
+			b.owner < NO_OWNER || b.owner >= num_olds ||
+			(bp = find_best(b.uid, 1)) == NULL)
+			ok = 0;
+		else
+		{
+			bp->time = b.time;
+			bp->owner = b.owner;
+		}
+	}
+
+	fclose(fp);
+
+	if (!ok)										//start over
+	{
+		for (i = 0; i < (uint64_t) num_olds; i++)
+		{
+			free(olds[i].path);
+			mem_free(olds[i].hash);
+		}
+		num_olds = 0;
+		tab_used = 0;
+		if (table != NULL)
+			memset(table, 0xff, tab_cap * sizeof(struct best));
+	}
+
+	return ok;
+}
+
+/*
+ *	mark_dirty()
+ *	Purpose: queue a UID's record to be written to the merged lastlog
+ *	 Return: 0 on success, -1 if memory ran out
+ *	   Note: A UID is queued once; a later record for it replaces the
+ *			 queued one.
+ */
+int mark_dirty(struct best *bp, int uid, struct lastlog *lp)
+{
+	if (bp->dirty >= 0)
+	{
+		dirty[bp->dirty].ll = *lp;
+		return 0;
+	}
+
+	if (num_dirty == cap_dirty)
+	{
+		struct dirty_rec *bigger = mem_realloc(dirty, (2 * cap_dirty + 256) *
+											   sizeof(struct dirty_rec));
+		if (bigger == NULL)
+			return -1;
+		dirty = bigger;
+		cap_dirty = 2 * cap_dirty + 256;
+	}
+
+	dirty[num_dirty].uid = uid;
+	dirty[num_dirty].ll = *lp;
+	bp->dirty = num_dirty++;
+
+	return 0;
+}
+
+/*
+ *	match_sources()
+ *	Purpose: find each listed source in the last run, and renumber the
+ *			 table's owners to this run's list
+ *	 Return: 0 on success, -1 if memory ran out
+ *	 Method: The last run's sources are sorted by path and each listed
+ *			 path is looked up with bsearch(), so thousands of hosts cost
+ *			 n log n. UIDs owned by a source that is no longer listed are
+ *			 marked for recompute().
+ */
+int match_sources()
+{
+	int *renum = malloc((num_olds + 1) * sizeof(int));
+	size_t k;
+	int i;
+
+	if (renum == NULL)
+		return -1;
+
+	for (i = 0; i < num_olds; i++)
+	{
+		renum[i] = NO_OWNER;
+		olds[i].was = i;						//kept across the sort
+	}
+	qsort(olds, num_olds, sizeof(struct source), cmp_path);
+
+	for (i = 0; i < num_srcs; i++)
+	{
+		struct source *op = bsearch(&srcs[i], olds, num_olds,
+									sizeof(struct source), cmp_path);
+
+		srcs[i].was = (op != NULL) ? op - olds : -1;
+		if (op != NULL && renum[op->was] == NO_OWNER)	//listed twice: first
+			renum[op->was] = i;
+	}
+
+	for (k = 0; k < tab_cap; k++)
+	{
+		struct best *bp = &table[k];
+
+		if (bp->uid == -1 || bp->owner == NO_OWNER)
+			continue;
+		bp->owner = renum[bp->owner];
+		if (bp->owner == NO_OWNER)				//its source is gone
+			bp->dirty = RECOMPUTE;
+	}
+
+	free(renum);
+	return 0;
+}
+
+/*
+ *	read_list()
+ *	Purpose: read the list of sources, one path per line
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	   Note: Blank lines and lines starting with '#' are skipped, as is
+ *			 white space around a path.
+ */
+int read_list(char *path)
+{
+	FILE *fp = fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	int scap = 0;
+
+	if (fp == NULL)
+		return -1;
+
+	while (getline(&line, &cap, fp) != -1)
+	{
+		char *p = line + strspn(line, " \t");
+
+		p[strcspn(p, " \t\r\n")] = '\0';
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (num_srcs == scap)
+		{
+			struct source *bigger = realloc(srcs, (2 * scap + 64) *
+											sizeof(struct source));
+			if (bigger == NULL)
+				break;
+			srcs = bigger;
+			scap = 2 * scap + 64;
+		}
+
+		memset(&srcs[num_srcs], 0, sizeof(struct source));
+		if ( (srcs[num_srcs].path = strdup(p)) == NULL )
+			break;
+		num_srcs++;
+	}
+
+	free(line);
+	if (ferror(fp) || !feof(fp))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/*
+ *	read_recs()
+ *	Purpose: read a run of records from a source
+ *	  Input: fd, the source
+ *			 first, n, the run
+ *			 recs, room for n records
+ *	 Return: 0 on success, -1 on a read error
+ *	   Note: Records past the end of the file, and a partial last record,
+ *			 read as zeros: never logged in.
+ */
+int read_recs(int fd, long first, long n, struct lastlog *recs)
+{
+	ssize_t amt = pread(fd, recs, n * LLSIZE, (off_t) first * LLSIZE);
+
+	if (amt == -1)
+		return -1;
+
+	amt = (amt / LLSIZE) * LLSIZE;
+	memset((char *) recs + amt, 0, n * LLSIZE - amt);
+
+	return 0;
+}
+
+/*
+ *	recompute()
+ *	Purpose: find the latest login again for UIDs whose latest source lost it
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: The UIDs are sorted and each source is opened once and asked
+ *			 for all of them, one pread() each. The latest login wins, the
+ *			 first listed source on a tie. This is the only step that reads
+ *			 unchanged sources, and only for these UIDs.
+ */
+int recompute()
+{
+	struct lastlog *cand, rec;
+	int *uids, *owner, n = 0, i, k;
+	size_t s;
+
+	for (s = 0; s < tab_cap; s++)
+		n += (table[s].uid != -1 && table[s].dirty == RECOMPUTE);
+	if (n == 0)
+		return 0;
+
+	uids = mem_alloc(n * sizeof(int));
+	owner = mem_alloc(n * sizeof(int));
+	cand = mem_calloc(n, LLSIZE);
+	if (uids == NULL || owner == NULL || cand == NULL)
+	{
+		mem_free(uids);
+		mem_free(owner);
+		mem_free(cand);
+		return -1;
+	}
+
+	for (s = 0, k = 0; s < tab_cap; s++)
+		if (table[s].uid != -1 && table[s].dirty == RECOMPUTE)
+			uids[k++] = table[s].uid;
+	qsort(uids, n, sizeof(int), cmp_int);
+
+	for (k = 0; k < n; k++)
+		owner[k] = NO_OWNER;
+
+	for (i = 0; i < num_srcs; i++)
+	{
+		int fd = open(srcs[i].path, O_RDONLY);
+
+		if (fd == -1)
+		{
+			mem_free(uids);
+			mem_free(owner);
+			mem_free(cand);
+			return -1;
+		}
+
+		for (k = 0; k < n; k++)
+			if (read_recs(fd, uids[k], 1, &rec) == 0 &&
+				rec.ll_time > cand[k].ll_time)
+			{
+				cand[k] = rec;
+				owner[k] = i;
+			}
+		close(fd);
+	}
+
+	for (k = 0; k < n; k++)
+	{
+		struct best *bp = find_best(uids[k], 0);
+
+		bp->time = cand[k].ll_time;
+		bp->owner = owner[k];
+		bp->dirty = NOT_DIRTY;
+		if (mark_dirty(bp, uids[k], &cand[k]) == -1)
+			break;
+	}
+
+	stats.recomputed = n;
+	mem_free(uids);
+	mem_free(owner);
+	mem_free(cand);
+
+	return (k == n) ? 0 : -1;
+}
+
+/*
+ *	save_state()
+ *	Purpose: record the sources and the table for the next run
+ *	  Input: path, the state file
+ *			 dst_st, the merged lastlog's stat, as this run left it
+ *	 Return: 0 on success, -1 on error
+ *	 Method: write PATH.tmp, then rename() it over PATH. UIDs with no
+ *			 login left (time 0) are dropped.
+ */
+int save_state(char *path, struct stat *dst_st)
+{
+	char tmp[PATH_MAX + 8];
+	struct state_head h;
+	FILE *fp;
+	size_t k;
+	int i, ok = 1;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	memcpy(h.magic, STATE_MAGIC, sizeof(h.magic));
+	h.nsrc = num_srcs;
+	h.nbest = 0;
+	h.dst_size = dst_st->st_size;
+	h.dst_mtime_ns = (uint64_t) dst_st->st_mtim.tv_sec * 1000000000ULL +
+					 dst_st->st_mtim.tv_nsec;
+	h.dst_ino = dst_st->st_ino;
+	for (k = 0; k < tab_cap; k++)
+		h.nbest += (table[k].uid != -1 && table[k].time != 0);
+
+	if ( (fp = fopen(tmp, "w")) == NULL )
+		return -1;
+
+	ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+
+	for (i = 0; ok && i < num_srcs; i++)
+	{
+		struct source *sp = &srcs[i];
+
+		sp->id.path_len = strlen(sp->path);
+		ok = fwrite(&sp->id, sizeof(sp->id), 1, fp) == 1 &&
+			 fwrite(sp->path, 1, sp->id.path_len, fp) == sp->id.path_len &&
+			 fwrite(sp->hash, sizeof(uint64_t), sp->id.nblocks, fp) ==
+				sp->id.nblocks;
+	}
+
+	for (k = 0; ok && k < tab_cap; k++)
+	{
+		struct best b = table[k];
+
+		if (b.uid == -1 || b.time == 0)
+			continue;
+		b.dirty = NOT_DIRTY;
+		ok = fwrite(&b, sizeof(b), 1, fp) == 1;
+	}
+
+	if (fclose(fp) == EOF || !ok)
+		return -1;
+
+	return rename(tmp, path);
+}
+
+/*
+ *	scan_source()
+ *	Purpose: bring the table up to date with one source
+ *	  Input: i, index of the source
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: If size, mtime and inode match the last run, its hashes are
+ *			 kept and it is not read. Otherwise its blocks are hashed and
+ *			 compared with the last run's; each run of changed blocks
+ *			 (including blocks cut off by truncation, and data turned into
+ *			 holes) is read again as whole records and given to
+ *			 apply_record().
+ */
+int scan_source(int i)
+{
+	static struct lastlog recs[READ_RECS];
+	struct source *sp = &srcs[i];
+	struct source *op = (sp->was >= 0) ? &olds[sp->was] : NULL;
+	struct stat st;
+	uint64_t b, b0, nb, old_nb;
+	int fd = open(sp->path, O_RDONLY);
+
+	if (fd == -1 || fstat(fd, &st) == -1)
+		return -1;
+
+	sp->id.size = st.st_size;
+	sp->id.mtime_ns = (uint64_t) st.st_mtim.tv_sec * 1000000000ULL +
+					  st.st_mtim.tv_nsec;
+	sp->id.ino = st.st_ino;
+	sp->id.nblocks = (st.st_size + MERGE_BLOCK - 1) / MERGE_BLOCK;
+
+	if (op != NULL && op->id.size == sp->id.size &&
+		op->id.mtime_ns == sp->id.mtime_ns && op->id.ino == sp->id.ino &&
+		op->id.nblocks == sp->id.nblocks)
+	{
+		sp->hash = op->hash;					//unchanged: not read
+		stats.unchanged++;
+		close(fd);
+		return 0;
+	}
+
+	nb = sp->id.nblocks;
+	old_nb = (op != NULL) ? op->id.nblocks : 0;
+	stats.blocks += nb;
+
+	if ( (sp->hash = mem_calloc(nb + 1, sizeof(uint64_t))) == NULL ||
+		 hash_source(fd, sp, st.st_size) == -1 )
+	{
+		close(fd);
+		return -1;
+	}
+
+	for (b = 0; b < nb || b < old_nb; )
+	{
+		uint64_t h = (b < nb) ? sp->hash[b] : HOLE_HASH;
+		uint64_t was = (b < old_nb) ? op->hash[b] : HOLE_HASH;
+		long r, r1;
+
+		if (h == was)
+		{
+			b++;
+			continue;
+		}
+
+		for (b0 = b++; b < nb || b < old_nb; b++)		//the changed run
+			if (((b < nb) ? sp->hash[b] : HOLE_HASH) ==
+				((b < old_nb) ? op->hash[b] : HOLE_HASH))
+				break;
+		stats.rescanned += b - b0;
+
+		r1 = (b * MERGE_BLOCK + LLSIZE - 1) / LLSIZE;
+		for (r = b0 * MERGE_BLOCK / LLSIZE; r < r1; r += READ_RECS)
+		{
+			long n = (r1 - r < READ_RECS) ? r1 - r : READ_RECS, k;
+
+			if (read_recs(fd, r, n, recs) == -1)
+			{
+				close(fd);
+				return -1;
+			}
+			for (k = 0; k < n; k++)
+				if (apply_record(i, r + k, &recs[k]) == -1)
+				{
+					close(fd);
+					return -1;
+				}
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+/*
+ *	write_merged()
+ *	Purpose: write the queued records to the merged lastlog, in UID order
+ *	  Input: dst, the merged lastlog
+ *			 fresh, nonzero if there was no state for dst: it is emptied
+ *				first
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ */
+int write_merged(char *dst, int fresh)
+{
+	struct lastlog **lls = mem_alloc((num_dirty + 1) *
+									 sizeof(struct lastlog *));
+	int *recs = mem_alloc((num_dirty + 1) * sizeof(int));
+	int fd = open(dst, O_RDWR | O_CREAT, 0644);
+	int i, rv = 0;
+
+	if (lls == NULL || recs == NULL || fd == -1)
+		rv = -1;
+
+	if (rv == 0)
+	{
+		qsort(dirty, num_dirty, sizeof(struct dirty_rec), cmp_dirty);
+		for (i = 0; i < num_dirty; i++)
+			if (dirty[i].uid != -1)				//-1: voided, sorted first
+			{
+				recs[stats.written] = dirty[i].uid;
+				lls[stats.written++] = &dirty[i].ll;
+			}
+	}
+
+	if (rv == 0 && fresh && ftruncate(fd, 0) == -1)
+		rv = -1;
+	if (rv == 0 && (ll_write_recs(fd, recs, lls, stats.written) == -1 ||
+					fsync(fd) == -1))
+		rv = -1;
+	if (fd != -1 && close(fd) == -1)
+		rv = -1;
+
+	if (rv == -1)
+		perror(dst);
+
+	mem_free(lls);
+	mem_free(recs);
+	return rv;
+}
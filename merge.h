@@ -0,0 +1,5 @@
+/*
+ * merge.h - header file with functions located in merge.c
+ */
+
+int merge_files(char *, char *);
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE					//for fallocate() and FALLOC_FL_*
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lllib.h"
+#include "mirror.h"
+#include "prof.h"
+
+#define MIRROR_BLOCK	4096		//bytes compared and copied at a time
+#define MIRROR_CHUNK	256			//blocks read from the source per pread()
+#define MANIFEST_EXT	".manifest"	//manifest is PATH.manifest
+#define MANIFEST_MAGIC	"LLMIRR2"	//first 8 bytes of a manifest
+
+/*
+ * file_id - what tells a file changed: size, modification time, inode
+ */
+struct file_id {
+	uint64_t size;
+	uint64_t mtime_ns;
+	uint64_t ino;
+};
+
+/*
+ * manifest - the state of the source as of the last mirror run: the file
+ * identity, to skip a run outright, and one hash per MIRROR_BLOCK block;
+ * and the copy's identity after that run, as the hashes only say what the
+ * copy holds while it is the same file
+ */
+struct manifest {
+	char magic[8];					//MANIFEST_MAGIC
+	struct file_id src;				//the source
+	struct file_id dst;				//the copy, as last written
+	uint64_t nblocks;				//hashes that follow the header
+};
+
+/*
+ * mirror_stats - what a run did, for the summary line
+ */
+struct mirror_stats {
+	long blocks;					//blocks in the source
+	long holes;						//of those, holes (or all zeros)
+	long written;					//blocks written to the copy
+	long punched;					//blocks turned into holes in the copy
+};
+
+static int dst_fd;					//the copy, open for writing
+static uint64_t *old_hash;			//hashes from the manifest, or NULL
+static uint64_t old_blocks;			//number of old_hash entries
+static uint64_t *new_hash;			//hashes of this run
+static struct mirror_stats stats;
+
+int copy_extent(int, off_t, off_t);
+void get_id(struct file_id *, struct stat *);
+int load_manifest(char *, struct stat *, struct stat *);
+int open_dst(char *, struct stat *);
+int punch_block(uint64_t);
+int save_manifest(char *, struct stat *, struct stat *, uint64_t);
+
+/*
+ *	mirror_file()
+ *	Purpose: bring a copy of a lastlog file up to date, writing only what
+ *			 changed since the last run
+ *	  Input: src, the lastlog file
+ *			 dst, the copy, created if it does not exist
+ *	 Output: a summary line of blocks written and punched
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: The manifest, dst.manifest, holds the source's size, mtime and
+ *			 inode and a hash per MIRROR_BLOCK block from the last run, and
+ *			 the same identity for dst as that run left it. If both are
+ *			 unchanged the run is done. Otherwise only the
+ *			 source's data extents are read; a block is written to dst with
+ *			 pwrite() only if its hash changed, and a block that is a hole
+ *			 (or all zeros) in the source is punched out of dst if it held
+ *			 data before. The new manifest is written to a temporary file
+ *			 and renamed over the old one, so an interrupted run leaves a
+ *			 manifest that still matches what was last copied.
+ *	   Note: Without a manifest (first run, or a copy made some other way),
+ *			 or if dst was just created or changed since the last run, the
+ *			 old hashes say nothing about it: every data block is written
+ *			 and every hole punched.
+ */
+int mirror_file(char *src, char *dst)
+{
+	char mpath[4096];
+	struct stat st, dst_st;
+	off_t *ext = NULL;
+	int src_fd, n, i, rv = 0;
+	uint64_t b, nblocks;
+
+	snprintf(mpath, sizeof(mpath), "%s%s", dst, MANIFEST_EXT);
+
+	if ( (src_fd = open(src, O_RDONLY)) == -1 || fstat(src_fd, &st) == -1 )
+	{
+		perror(src);
+		if (src_fd != -1)
+			close(src_fd);
+		return -1;
+	}
+
+	if ( (dst_fd = open_dst(dst, &dst_st)) == -1 )
+	{
+		perror(dst);
+		close(src_fd);
+		return -1;
+	}
+
+	prof_enter("mirror_file");
+	nblocks = (st.st_size + MIRROR_BLOCK - 1) / MIRROR_BLOCK;
+	memset(&stats, 0, sizeof(stats));
+	stats.blocks = nblocks;
+
+	if (load_manifest(mpath, &st, &dst_st) == 1)		//nothing changed
+	{
+		printf("mirror: %s unchanged, nothing to do\n", src);
+		close(src_fd);
+		close(dst_fd);
+		free(old_hash);
+		prof_exit();
+		return 0;
+	}
+
+	if ( (new_hash = calloc(nblocks + 1, sizeof(uint64_t))) == NULL ||
+		 (n = ll_extents(src_fd, st.st_size, &ext, 0)) == -1 )
+	{
+		//no SEEK_DATA: treat the whole file as one extent
+		n = 1;
+		if (new_hash == NULL || (ext = malloc(2 * sizeof(off_t))) == NULL)
+		{
+			perror("alastlog");
+			close(src_fd);
+			close(dst_fd);
+			free(old_hash);
+			free(new_hash);
+			prof_exit();
+			return -1;
+		}
+		ext[0] = 0;
+		ext[1] = st.st_size;
+	}
+
+	for (i = 0; i < n && rv == 0; i++)					//data: compare, copy
+		rv = copy_extent(src_fd, ext[2 * i], ext[2 * i + 1]);
+
+	for (b = 0; b < nblocks && rv == 0; b++)			//holes: punch
+	{
+		if (new_hash[b] != HOLE_HASH)
+			continue;
+
+		stats.holes++;
+		if (old_hash == NULL || (b < old_blocks && old_hash[b] != HOLE_HASH))
+			rv = punch_block(b);
+	}
+
+	if (rv == 0 && ftruncate(dst_fd, st.st_size) == -1)
+		rv = -1;
+	if (rv == 0 && fsync(dst_fd) == -1)
+		rv = -1;
+	if (rv == 0 && fstat(dst_fd, &dst_st) == -1)		//as this run left it
+		rv = -1;
+	if (rv == 0)
+		rv = save_manifest(mpath, &st, &dst_st, nblocks);
+
+	if (rv == -1)
+		perror(dst);
+	else
+		printf("mirror: %ld blocks, %ld holes, %ld written, %ld punched\n",
+			   stats.blocks, stats.holes, stats.written, stats.punched);
+
+	close(src_fd);
+	close(dst_fd);
+	free(ext);
+	free(old_hash);
+	free(new_hash);
+	prof_exit();
+
+	return rv;
+}
+
+/*
+ *	block_hash()
+ *	Purpose: hash one block, FNV-1a style, a 64-bit word at a time
+ *	 Return: the hash, never HOLE_HASH; HOLE_HASH if the block is all zeros
+ *	   Note: len is a multiple of 8 except for the last block of the file;
+ *			 the tail is hashed a byte at a time.
+ */
+uint64_t block_hash(const unsigned char *p, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL, any = 0, w;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		memcpy(&w, p + i, 8);
+		any |= w;
+		h = (h ^ w) * 0x100000001b3ULL;
+	}
+
+	for (; i < len; i++)
+	{
+		any |= p[i];
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	}
+
+	if (any == 0)
+		return HOLE_HASH;
+
+	return (h == HOLE_HASH) ? 1 : h;
+}
+
+/*
+ *	copy_extent()
+ *	Purpose: hash the blocks of one source data extent and write the ones
+ *			 that changed to the copy
+ *	  Input: fd, the source
+ *			 start, end, the extent, in bytes
+ *	 Return: 0 on success, -1 on a read or write error
+ *	 Method: Read MIRROR_CHUNK blocks at a time. Blocks that changed and
+ *			 sit next to each other are written with a single pwrite(); the
+ *			 loop runs one block past the data read so a run reaching the
+ *			 end of it is flushed too.
+ */
+int copy_extent(int fd, off_t start, off_t end)
+{
+	static unsigned char buf[MIRROR_CHUNK * MIRROR_BLOCK];
+	off_t pos = (start / MIRROR_BLOCK) * MIRROR_BLOCK;	//block aligned
+
+	while (pos < end)
+	{
+		ssize_t amt = pread(fd, buf, sizeof(buf), pos);
+		ssize_t off, run = -1;							//start of changed run
+
+		if (amt <= 0)
+			return (amt == 0) ? 0 : -1;
+
+		for (off = 0; off < amt + MIRROR_BLOCK; off += MIRROR_BLOCK)
+		{
+			uint64_t b = (pos + off) / MIRROR_BLOCK;
+			int changed = 0;
+
+			if (off < amt && pos + off < end)
+			{
+				size_t len = (amt - off < MIRROR_BLOCK) ? amt - off
+														: MIRROR_BLOCK;
+				new_hash[b] = block_hash(buf + off, len);
+				changed = new_hash[b] != HOLE_HASH &&
+						  (old_hash == NULL || b >= old_blocks ||
+						   old_hash[b] != new_hash[b]);
+			}
+
+			if (changed && run == -1)
+				run = off;
+			else if (!changed && run != -1)				//flush the run
+			{
+				size_t len = ((off < amt) ? off : amt) - run;
+
+				if (pwrite(dst_fd, buf + run, len, pos + run) != (ssize_t) len)
+					return -1;
+				stats.written += (len + MIRROR_BLOCK - 1) / MIRROR_BLOCK;
+				run = -1;
+			}
+		}
+
+		pos += amt;
+	}
+
+	return 0;
+}
+
+/*
+ *	get_id() - fill in a file_id from a stat
+ */
+void get_id(struct file_id *id, struct stat *st)
+{
+	id->size = st->st_size;
+	id->mtime_ns = (uint64_t) st->st_mtim.tv_sec * 1000000000ULL +
+				   st->st_mtim.tv_nsec;
+	id->ino = st->st_ino;
+}
+
+/*
+ *	load_manifest()
+ *	Purpose: read the manifest left by the last run
+ *	  Input: path, the manifest file
+ *			 st, the source's current stat
+ *			 dst_st, the copy's current stat, st_ino 0 if it was just made
+ *	 Return: 1 if neither file changed since then, 0 otherwise; old_hash
+ *			 is set to the old hashes, or NULL if there is no usable
+ *			 manifest or the copy is not the one they describe
+ */
+int load_manifest(char *path, struct stat *st, struct stat *dst_st)
+{
+	struct manifest m;
+	struct file_id src_id, dst_id;
+	FILE *fp = fopen(path, "r");
+
+	old_hash = NULL;
+	old_blocks = 0;
+
+	if (fp == NULL)
+		return 0;
+
+	if (fread(&m, sizeof(m), 1, fp) != 1 ||
+		memcmp(m.magic, MANIFEST_MAGIC, sizeof(m.magic)) != 0 ||
+		(old_hash = malloc((m.nblocks + 1) * sizeof(uint64_t))) == NULL ||
+		fread(old_hash, sizeof(uint64_t), m.nblocks, fp) != m.nblocks)
+	{
+		free(old_hash);
+		old_hash = NULL;
+		fclose(fp);
+		return 0;
+	}
+
+	fclose(fp);
+	old_blocks = m.nblocks;
+	get_id(&src_id, st);
+	get_id(&dst_id, dst_st);
+
+	if (dst_st->st_ino == 0 || memcmp(&m.dst, &dst_id, sizeof(dst_id)) != 0)
+	{												//not the copy we made
+		free(old_hash);
+		old_hash = NULL;
+		old_blocks = 0;
+		return 0;
+	}
+
+	return memcmp(&m.src, &src_id, sizeof(src_id)) == 0;
+}
+
+/*
+ *	open_dst()
+ *	Purpose: open the copy for writing, creating it if it does not exist
+ *	  Input: path, the copy
+ *			 st, set to its stat; st_ino is 0 if this call created it
+ *	 Return: the descriptor, or -1 on error (errno is set)
+ */
+int open_dst(char *path, struct stat *st)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd != -1)									//new: no old contents
+	{
+		memset(st, 0, sizeof(*st));
+		return fd;
+	}
+
+	if (errno != EEXIST || (fd = open(path, O_RDWR)) == -1)
+		return -1;
+
+	if (fstat(fd, st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ *	punch_block()
+ *	Purpose: turn one block of the copy into a hole
+ *	 Return: 0 on success, -1 on error
+ *	   Note: If the filesystem cannot punch holes, zeros are written
+ *			 instead, so the copy's contents are still right.
+ */
+int punch_block(uint64_t b)
+{
+	static const char zeros[MIRROR_BLOCK];
+	off_t off = (off_t) b * MIRROR_BLOCK;
+
+	stats.punched++;
+
+	if (fallocate(dst_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				  off, MIRROR_BLOCK) == 0)
+		return 0;
+
+	if (errno != EOPNOTSUPP)
+		return -1;
+
+	return pwrite(dst_fd, zeros, MIRROR_BLOCK, off) == MIRROR_BLOCK ? 0 : -1;
+}
+
+/*
+ *	save_manifest()
+ *	Purpose: record the source's identity and block hashes, and the copy's
+ *			 identity, for next time
+ *	 Return: 0 on success, -1 on error
+ *	 Method: write PATH.tmp, then rename() it over PATH
+ */
+int save_manifest(char *path, struct stat *st, struct stat *dst_st,
+				  uint64_t nblocks)
+{
+	char tmp[4096 + 8];
+	struct manifest m;
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	memcpy(m.magic, MANIFEST_MAGIC, sizeof(m.magic));
+	get_id(&m.src, st);
+	get_id(&m.dst, dst_st);
+	m.nblocks = nblocks;
+
+	if ( (fp = fopen(tmp, "w")) == NULL )
+		return -1;
+
+	if (fwrite(&m, sizeof(m), 1, fp) != 1 ||
+		fwrite(new_hash, sizeof(uint64_t), nblocks, fp) != nblocks)
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	if (fclose(fp) == EOF)
+		return -1;
+
+	return rename(tmp, path);
+}
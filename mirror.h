@@ -0,0 +1,11 @@
+/*
+ * mirror.h - header file with functions located in mirror.c
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HOLE_HASH		0			//block_hash() of a hole, or all zeros
+
+uint64_t block_hash(const unsigned char *, size_t);
+int mirror_file(char *, char *);
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include "prof.h"
+
+#define PROF_DEPTH	16				//deepest span stack that is recorded
+#define PROF_SLOTS	1024			//distinct stacks kept in the table
+#define PROF_USEC	1000			//sampling interval, in microseconds
+#define PROF_ROOT	"alastlog"		//root frame of every folded stack
+
+struct prof_slot {
+	int depth;						//number of frames, 0 if slot is unused
+	const char *frames[PROF_DEPTH];	//span names, outermost first
+	long count;						//number of samples for this stack
+};
+
+static const char * volatile stack[PROF_DEPTH];	//current span stack
+static volatile int depth;						//frames on the stack
+static int prof_on;								//is sampling enabled
+static long lost;								//samples with a full table
+static volatile int busy;						//a handler is in the table
+static FILE *prof_fp;							//folded output destination
+static pthread_t prof_tid;						//thread that owns the stack
+
+static struct prof_slot table[PROF_SLOTS];		//sample counts per stack
+
+static void prof_sample(int);		//internal SIGPROF handler
+
+/*
+ *	prof_start()
+ *	Purpose: open the profile output file and start the SIGPROF sampler
+ *	  Input: fname, file that folded stacks are written to by prof_stop()
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: The file is opened up front so a bad path is reported before
+ *			 any work is done. An ITIMER_PROF timer then delivers SIGPROF
+ *			 every PROF_USEC of CPU time; each delivery charges one sample
+ *			 to the span stack that is current at that moment.
+ */
+int prof_start(char *fname)
+{
+	struct sigaction sa;
+	struct itimerval it;
+
+	if ( (prof_fp = fopen(fname, "w")) == NULL )
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = prof_sample;
+	sa.sa_flags = SA_RESTART;			//don't make read() fail with EINTR
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGPROF, &sa, NULL) == -1)
+		return -1;
+
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = PROF_USEC;
+	it.it_value = it.it_interval;
+
+	prof_tid = pthread_self();
+	prof_on = 1;
+	return setitimer(ITIMER_PROF, &it, NULL);
+}
+
+/*
+ *	prof_enter()
+ *	Purpose: push a named span onto the stack
+ *	  Input: name, a string literal naming the span (pointer is kept)
+ *	   Note: Costs a single flag test when profiling is off. Spans nested
+ *			 deeper than PROF_DEPTH are counted but not named, so samples
+ *			 taken there are charged to the deepest recorded frame. There
+ *			 is one stack, owned by the thread that called prof_start();
+ *			 spans from other threads are ignored, so their samples are
+ *			 charged to whatever that thread is doing.
+ */
+void prof_enter(const char *name)
+{
+	if (!prof_on || !pthread_equal(pthread_self(), prof_tid))
+		return;
+
+	if (depth < PROF_DEPTH)
+		stack[depth] = name;			//frame is set before depth grows
+
+	depth++;
+}
+
+/*
+ *	prof_exit()
+ *	Purpose: pop the innermost span off the stack
+ */
+void prof_exit()
+{
+	if (prof_on && depth > 0 && pthread_equal(pthread_self(), prof_tid))
+		depth--;
+}
+
+/*
+ *	prof_sample()
+ *	Purpose: SIGPROF handler, count one sample against the current stack
+ *	 Method: Hash the frame pointers and probe the table linearly. Only
+ *			 touches static memory, so it is async-signal-safe. Names are
+ *			 compared by pointer; every span name is a string literal.
+ *	   Note: SIGPROF can arrive on several threads at once; busy lets one
+ *			 handler into the table at a time and the others count as lost.
+ */
+static void prof_sample(int signum)
+{
+	int n = (depth < PROF_DEPTH) ? depth : PROF_DEPTH;
+	unsigned long hash = n;
+	int i, j;
+
+	(void) signum;
+
+	if (__sync_lock_test_and_set(&busy, 1))
+	{
+		__sync_fetch_and_add(&lost, 1);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		hash = hash * 31 + (unsigned long) stack[i];
+
+	for (j = 0; j < PROF_SLOTS; j++)
+	{
+		struct prof_slot *sp = &table[(hash + j) % PROF_SLOTS];
+
+		if (sp->count == 0)					//unused slot, claim it
+		{
+			sp->depth = n;
+			for (i = 0; i < n; i++)
+				sp->frames[i] = stack[i];
+		}
+		else if (sp->depth != n ||
+				 memcmp(sp->frames, (const void *) stack,
+						n * sizeof(char *)) != 0)
+			continue;						//another stack, keep probing
+
+		sp->count++;
+		__sync_lock_release(&busy);
+		return;
+	}
+
+	__sync_fetch_and_add(&lost, 1);			//table full; others may count too
+	__sync_lock_release(&busy);
+}
+
+/*
+ *	prof_stop()
+ *	Purpose: stop sampling and write the folded stacks
+ *	 Output: one line per distinct stack, frames separated by ';' followed
+ *			 by a space and the sample count, e.g.
+ *			 "alastlog;get_log;render_rows 42". This is the input
+ *			 format of flamegraph.pl and most other flame graph tools.
+ *	 Return: 0 on success, -1 on a write or close error
+ */
+int prof_stop()
+{
+	struct itimerval it;
+	int i, j;
+
+	if (!prof_on)
+		return 0;
+
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_PROF, &it, NULL);
+	signal(SIGPROF, SIG_IGN);
+	prof_on = 0;
+
+	for (i = 0; i < PROF_SLOTS; i++)
+	{
+		if (table[i].count == 0)
+			continue;
+
+		fprintf(prof_fp, "%s", PROF_ROOT);
+		for (j = 0; j < table[i].depth; j++)
+			fprintf(prof_fp, ";%s", table[i].frames[j]);
+		fprintf(prof_fp, " %ld\n", table[i].count);
+	}
+
+	if (lost > 0)
+		fprintf(prof_fp, "%s;[lost] %ld\n", PROF_ROOT, lost);
+
+	return fclose(prof_fp) == 0 ? 0 : -1;
+}
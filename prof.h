@@ -0,0 +1,8 @@
+/*
+ * prof.h - header file with functions located in prof.c
+ */
+
+int prof_start(char *);
+void prof_enter(const char *);
+void prof_exit();
+int prof_stop();
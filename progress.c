@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <errno.h>
+#include <lastlog.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lllib.h"
+#include "progress.h"
+
+#define LLSIZE			(sizeof(struct lastlog))
+#define LINE_MAX_LEN	256			//longest progress line
+#define MB				1048576.0
+
+static struct ll_progress base;		//totals when progress_start() ran
+static struct timespec t0;			//and when
+static long expect;					//lookups the run will make, 0 unknown
+static int every;					//seconds between reports, 0 for none
+static pthread_t tid;				//reporter thread, if every > 0
+static int running;					//tid was started
+static int stopping;				//progress_stop() wants tid to end
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;	//for wake
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;		//stop now
+static struct sigaction old_usr1;	//SIGUSR1 handling to put back
+
+static void on_usr1(int);
+static int put_num(char *, double, int);
+static int put_str(char *, const char *);
+static void *reporter(void *);
+
+/*
+ *	progress_start()
+ *	Purpose: start reporting how a scan is going, to stderr
+ *	  Input: secs, seconds between reports (--progress), 0 for reports on
+ *				SIGUSR1 only
+ *			 lookups, the number of records the scan will look up, for the
+ *				ETA; 0 if not known, then the ETA comes from how far into
+ *				the file the last lookup was
+ *	 Return: 0 on success, -1 if the reporter thread cannot be started
+ *	 Method: SIGUSR1 gets a handler that writes one report; the report is
+ *			 built with async-signal-safe code only (no stdio), from
+ *			 ll_progress(), so it can run in the handler. With secs, a
+ *			 thread also writes one every secs seconds. Neither touches the
+ *			 scan: lllib keeps its totals either way.
+ */
+int progress_start(int secs, long lookups)
+{
+	struct sigaction sa;
+
+	ll_progress(&base);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	expect = lookups;
+	every = secs;
+	stopping = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_usr1;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, &old_usr1);
+
+	if (every > 0)
+	{
+		if ( (errno = pthread_create(&tid, NULL, reporter, NULL)) != 0 )
+			return -1;
+		running = 1;
+	}
+
+	return 0;
+}
+
+/*
+ *	progress_stop()
+ *	Purpose: end the reports, with a last one if --progress was given
+ */
+void progress_stop()
+{
+	if (running)
+	{
+		pthread_mutex_lock(&lock);
+		stopping = 1;
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+		pthread_join(tid, NULL);
+		running = 0;
+		progress_report();
+	}
+
+	sigaction(SIGUSR1, &old_usr1, NULL);
+}
+
+/*
+ *	progress_report()
+ *	Purpose: write one progress line to stderr
+ *	 Output: "progress: uid U at OFFSET, R of S MB read, H holes, N
+ *			 lookups, L/s, eta Es"
+ *	   Note: Async-signal-safe: clock_gettime(), atomic loads, and one
+ *			 write(); errno is kept for the code the signal interrupted.
+ */
+void progress_report()
+{
+	char line[LINE_MAX_LEN];
+	struct ll_progress p;
+	struct timespec t1;
+	double secs, rate, done = -1;
+	long lookups;
+	int len = 0, saved = errno;
+
+	ll_progress(&p);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	lookups = p.lookups - base.lookups;
+	rate = (secs > 0) ? lookups / secs : 0;
+
+	if (expect > 0)								//fraction of the scan done
+		done = (double) lookups / expect;
+	else if (p.size > 0)						//or of the file, roughly
+		done = (double) (p.rec + 1) * LLSIZE / p.size;
+	if (done > 1)
+		done = 1;
+
+	len += put_str(line + len, "progress: uid ");
+	len += put_num(line + len, p.rec, 0);
+	len += put_str(line + len, " at ");
+	len += put_num(line + len, (double) p.rec * LLSIZE, 0);
+	len += put_str(line + len, ", ");
+	len += put_num(line + len, (p.bytes - base.bytes) / MB, 1);
+	len += put_str(line + len, " of ");
+	len += put_num(line + len, p.size / MB, 1);
+	len += put_str(line + len, " MB read, ");
+	len += put_num(line + len, p.holes - base.holes, 0);
+	len += put_str(line + len, " holes, ");
+	len += put_num(line + len, lookups, 0);
+	len += put_str(line + len, " lookups, ");
+	len += put_num(line + len, rate, 0);
+	len += put_str(line + len, "/s, eta ");
+	if (done > 0 && lookups > 0)
+	{
+		len += put_num(line + len, secs * (1 - done) / done, 0);
+		len += put_str(line + len, "s\n");
+	}
+	else
+		len += put_str(line + len, "?\n");
+
+	write(STDERR_FILENO, line, len);
+	errno = saved;
+}
+
+/*
+ *	on_usr1() - SIGUSR1 handler, one report
+ */
+static void on_usr1(int sig)
+{
+	(void) sig;
+	progress_report();
+}
+
+/*
+ *	put_num()
+ *	Purpose: format a number with 0 or 1 decimals, without stdio
+ *	 Return: chars written; at most 24
+ */
+static int put_num(char *buf, double v, int decimals)
+{
+	char digits[24];
+	unsigned long long n;
+	int len = 0, k = 0;
+
+	if (v < 0)
+		v = 0;
+	if (v > 1e18)
+		v = 1e18;
+	n = (unsigned long long) (decimals ? v * 10 + 0.5 : v + 0.5);
+
+	do
+	{
+		digits[k++] = '0' + n % 10;
+		n /= 10;
+		if (decimals && k == 1)
+			digits[k++] = '.';
+	} while (n > 0 || (decimals && k < 3));
+
+	while (k > 0)
+		buf[len++] = digits[--k];
+
+	return len;
+}
+
+/*
+ *	put_str() - copy a string without stdio, return its length
+ */
+static int put_str(char *buf, const char *s)
+{
+	int len = 0;
+
+	while (s[len] != '\0')
+	{
+		buf[len] = s[len];
+		len++;
+	}
+
+	return len;
+}
+
+/*
+ *	reporter()
+ *	Purpose: thread body for --progress, a report every `every` seconds
+ *	 Method: Waits on a condition variable with a timeout, so
+ *			 progress_stop() ends it at once instead of after a sleep.
+ */
+static void *reporter(void *arg)
+{
+	struct timespec due;
+
+	(void) arg;
+	clock_gettime(CLOCK_REALTIME, &due);
+
+	pthread_mutex_lock(&lock);
+	while (!stopping)
+	{
+		due.tv_sec += every;
+		if (pthread_cond_timedwait(&wake, &lock, &due) == ETIMEDOUT &&
+			!stopping)
+			progress_report();
+	}
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
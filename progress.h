@@ -0,0 +1,7 @@
+/*
+ * progress.h - header file with functions located in progress.c
+ */
+
+int progress_start(int, long);
+void progress_report();
+void progress_stop();
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mem.h"
+#include "pwfile.h"
+
+char *next_field(char **, int);
+int pw_parse(char *, struct pwent *);
+
+/*
+ *	pw_load()
+ *	Purpose: read a passwd(5) file directly, without going through NSS
+ *	  Input: path, the file, e.g. a container's ROOTFS/etc/passwd
+ *			 pl, where to store the entries
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: Read the whole file into one buffer, then split it in place:
+ *			 each ':' and newline becomes a '\0' and the entries point at
+ *			 the name fields, so there is a single allocation for the text.
+ *			 Lines are kept as pw_parse() says. Both allocations count
+ *			 against the memory budget (see mem.c); pw_read() is the way
+ *			 to go through a file that does not fit.
+ */
+int pw_load(char *path, struct pwlist *pl)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	ssize_t len = 0, amt;
+	int cap = 0;
+
+	pl->ents = NULL;
+	pl->n = 0;
+	pl->text = NULL;
+
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1 ||
+		(pl->text = mem_alloc(st.st_size + 1)) == NULL)
+	{
+		close(fd);
+		return -1;
+	}
+
+	while (len < st.st_size &&
+		   (amt = read(fd, pl->text + len, st.st_size - len)) > 0)
+		len += amt;
+
+	close(fd);
+	pl->text[len] = '\0';
+
+	char *line = pl->text;
+
+	while (*line != '\0')
+	{
+		char *rest = line + strcspn(line, "\n");
+		char *next = (*rest == '\n') ? rest + 1 : rest;
+		struct pwent pe;
+
+		*rest = '\0';							//line is now a string
+		if (!pw_parse(line, &pe))
+		{
+			line = next;
+			continue;
+		}
+		line = next;
+
+		if (pl->n == cap)						//grow the table
+		{
+			struct pwent *bigger = mem_realloc(pl->ents, (cap + 64) *
+											   sizeof(struct pwent));
+			if (bigger == NULL)
+			{
+				pw_free(pl);
+				return -1;
+			}
+			pl->ents = bigger;
+			cap += 64;
+		}
+
+		pl->ents[pl->n++] = pe;
+	}
+
+	return 0;
+}
+
+/*
+ *	pw_read()
+ *	Purpose: read the next usable entry of a passwd(5) file, a line at a
+ *			 time, for files too big to pw_load()
+ *	  Input: fp, the open file
+ *			 pe, where to store the entry, pointing into buf
+ *			 buf, size, room for one line
+ *	 Return: 1 if an entry was read, 0 at the end of the file
+ *	   Note: The part of a line past size - 1 bytes is skipped; the name
+ *			 and UID come first, so only absurd lines lose them.
+ */
+int pw_read(FILE *fp, struct pwent *pe, char *buf, int size)
+{
+	while (fgets(buf, size, fp) != NULL)
+	{
+		size_t len = strlen(buf);
+		int c;
+
+		if (len > 0 && buf[len - 1] == '\n')
+			buf[len - 1] = '\0';
+		else if (len == (size_t) size - 1)		//skip the rest of the line
+			while ( (c = getc(fp)) != EOF && c != '\n' )
+				;
+
+		if (pw_parse(buf, pe))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *	pw_free() - release the memory held by a pwlist
+ */
+void pw_free(struct pwlist *pl)
+{
+	mem_free(pl->ents);
+	mem_free(pl->text);
+	pl->ents = NULL;
+	pl->text = NULL;
+	pl->n = 0;
+}
+
+/*
+ *	next_field()
+ *	Purpose: split the next field off a string, strsep() style
+ *	  Input: sp, pointer to the rest of the string, advanced past the field
+ *			 sep, the field separator
+ *	 Return: the field, or NULL once the string is used up
+ */
+char *next_field(char **sp, int sep)
+{
+	char *field = *sp;
+	char *end;
+
+	if (field == NULL)
+		return NULL;
+
+	if ( (end = strchr(field, sep)) != NULL )
+	{
+		*end = '\0';
+		*sp = end + 1;
+	}
+	else
+		*sp = NULL;
+
+	return field;
+}
+
+/*
+ *	pw_parse()
+ *	Purpose: take the name and UID from one passwd line, split in place
+ *	 Return: 1 if the line is usable, 0 if it is skipped
+ *	   Note: Lines without a name and a numeric UID field are skipped, as
+ *			 are NIS "+" and "-" lines, which only mean something to NSS.
+ */
+int pw_parse(char *line, struct pwent *pe)
+{
+	char *name, *uid, *end;
+	unsigned long id;
+
+	name = next_field(&line, ':');
+	next_field(&line, ':');					//password
+	uid = next_field(&line, ':');
+
+	if (name[0] == '\0' || name[0] == '+' || name[0] == '-' ||
+		uid == NULL || uid[0] == '\0')
+		return 0;
+
+	id = strtoul(uid, &end, 10);
+	if (*end != '\0')
+		return 0;
+
+	pe->name = name;
+	pe->uid = (uid_t) id;
+
+	return 1;
+}
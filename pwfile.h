@@ -0,0 +1,27 @@
+/*
+ * pwfile.h - header file with functions located in pwfile.c
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * pwent - the two passwd fields alastlog uses, pointing into pwlist.text
+ */
+struct pwent {
+	char *name;						//login name
+	uid_t uid;						//numeric user ID
+};
+
+/*
+ * pwlist - every usable entry of one passwd file, in file order
+ */
+struct pwlist {
+	struct pwent *ents;				//the entries
+	int n;							//number of entries
+	char *text;						//the file contents, split in place
+};
+
+int pw_load(char *, struct pwlist *);
+int pw_read(FILE *, struct pwent *, char *, int);
+void pw_free(struct pwlist *);
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lastlog.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utmp.h>
+#include "lllib.h"
+#include "prof.h"
+#include "rebuild.h"
+#include "render.h"
+
+#define CHUNK_RECS		16384		//wtmp records per work item
+#define READ_RECS		512			//wtmp records per pread()
+#define NBUCKETS		65536		//hash chains in the user table
+#define NSTRIPES		256			//locks, each guarding NBUCKETS/NSTRIPES
+#define TMP_EXT			".rebuild"	//new lastlog is written as PATH.rebuild
+
+/*
+ * chunk - one work item: a run of records in one wtmp file
+ */
+struct chunk {
+	int file;						//index into rb_files
+	off_t first;					//first record
+	off_t count;					//number of records
+};
+
+/*
+ * seen - a user found in wtmp, with their latest login so far
+ */
+struct seen {
+	char name[UT_NAMESIZE + 1];		//ut_user, '\0' terminated
+	int uid;						//set once the scan is over, -1 unknown
+	struct lastlog ll;				//latest login
+	struct seen *next;				//next in the hash chain
+};
+
+/*
+ * rebuild_stats - what a run did, for the summary line
+ */
+struct rebuild_stats {
+	long records;					//wtmp records read
+	long logins;					//of those, USER_PROCESS entries
+	long users;						//distinct user names
+	long unknown;					//names that are not users here
+	long written;					//lastlog records written
+};
+
+static char **rb_files;				//the wtmp files
+static int *rb_fds;					//open descriptors for rb_files
+static struct chunk *chunks;		//work items, in file order
+static int num_chunks;				//number of chunks
+static int next_chunk;				//next chunk for a worker, counting down
+static int rb_failed;				//a read failed
+static struct seen *buckets[NBUCKETS];
+static pthread_mutex_t stripes[NSTRIPES];
+static pthread_mutex_t rb_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rebuild_stats stats;
+
+int cmp_seen(const void *, const void *);
+int make_chunks(int);
+void note_login(struct utmp *);
+void *scan_chunks(void *);
+int write_lastlog(char *, struct passwd *(*)(char *));
+
+/*
+ *	rebuild_file()
+ *	Purpose: write a new lastlog from the logins recorded in wtmp files
+ *	  Input: files, the wtmp files (e.g. /var/log/wtmp and its rotations)
+ *			 nfiles, number of files
+ *			 dst, the lastlog file to replace
+ *			 lookup, resolves a user name, as getpwnam()
+ *			 threads, number of threads scanning wtmp
+ *	 Output: a summary line of records read and written
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: The files are cut into CHUNK_RECS record chunks. Worker threads
+ *			 take chunks from the end backwards, so the newest logins are
+ *			 seen first and later (older) ones mostly lose the comparison
+ *			 without an update. Every USER_PROCESS record is reduced into a
+ *			 table of users, hash chains guarded by NSTRIPES locks, keeping
+ *			 the latest login. write_lastlog() then turns names into UIDs
+ *			 and writes the result.
+ *	   Note: wtmp holds names, not UIDs, so the table is keyed by name; each
+ *			 name is looked up once, after the scan, on this thread, since
+ *			 NSS lookups are not thread safe.
+ */
+int rebuild_file(char **files, int nfiles, char *dst,
+				 struct passwd *(*lookup)(char *), int threads)
+{
+	pthread_t tids[MAX_THREADS];
+	int started = 0, i, rv;
+
+	rb_files = files;
+	memset(&stats, 0, sizeof(stats));
+
+	prof_enter("rebuild_file");
+
+	for (i = 0; i < NSTRIPES; i++)
+		pthread_mutex_init(&stripes[i], NULL);
+
+	if (make_chunks(nfiles) == -1)
+	{
+		prof_exit();
+		return -1;
+	}
+
+	for (i = 1; i < threads && i < num_chunks; i++)
+		if (pthread_create(&tids[started], NULL, scan_chunks, NULL) == 0)
+			started++;
+
+	scan_chunks(NULL);						//this thread works too
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	for (i = 0; i < nfiles; i++)
+		close(rb_fds[i]);
+
+	if (rb_failed)
+		rv = -1;
+	else
+		rv = write_lastlog(dst, lookup);
+
+	if (rv == 0)
+		printf("rebuild: %ld records, %ld logins, %ld users, %ld unknown, "
+			   "%ld written\n", stats.records, stats.logins, stats.users,
+			   stats.unknown, stats.written);
+
+	for (i = 0; i < NBUCKETS; i++)
+		while (buckets[i] != NULL)
+		{
+			struct seen *sp = buckets[i];
+
+			buckets[i] = sp->next;
+			free(sp);
+		}
+
+	free(rb_fds);
+	free(chunks);
+	prof_exit();
+
+	return rv;
+}
+
+/*
+ *	cmp_seen() - qsort() comparison: by UID, then login time
+ */
+int cmp_seen(const void *a, const void *b)
+{
+	const struct seen *x = *(struct seen * const *) a;
+	const struct seen *y = *(struct seen * const *) b;
+
+	if (x->uid != y->uid)
+		return (x->uid > y->uid) - (x->uid < y->uid);
+
+	return (x->ll.ll_time > y->ll.ll_time) -
+		   (x->ll.ll_time < y->ll.ll_time);
+}
+
+/*
+ *	make_chunks()
+ *	Purpose: open the wtmp files and cut them into work items
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	   Note: A partial record at the end of a file, as left by a crash
+ *			 while it was written, is ignored.
+ */
+int make_chunks(int nfiles)
+{
+	struct stat st;
+	off_t recs, r;
+	int i, cap = 0;
+
+	num_chunks = 0;
+	chunks = NULL;
+
+	if ( (rb_fds = malloc(nfiles * sizeof(int))) == NULL )
+	{
+		perror("alastlog");
+		exit(1);
+	}
+
+	for (i = 0; i < nfiles; i++)
+	{
+		if ( (rb_fds[i] = open(rb_files[i], O_RDONLY)) == -1 ||
+			 fstat(rb_fds[i], &st) == -1 )
+		{
+			perror(rb_files[i]);
+			while (--i >= 0)
+				close(rb_fds[i]);
+			return -1;
+		}
+
+		recs = st.st_size / sizeof(struct utmp);
+		for (r = 0; r < recs; r += CHUNK_RECS)
+		{
+			if (num_chunks == cap)
+			{
+				cap = 2 * cap + 64;
+				if ( (chunks = realloc(chunks, cap * sizeof(struct chunk)))
+					 == NULL )
+				{
+					perror("alastlog");
+					exit(1);
+				}
+			}
+
+			chunks[num_chunks].file = i;
+			chunks[num_chunks].first = r;
+			chunks[num_chunks].count = (recs - r < CHUNK_RECS) ? recs - r
+															   : CHUNK_RECS;
+			num_chunks++;
+		}
+	}
+
+	next_chunk = num_chunks - 1;			//newest first
+
+	return 0;
+}
+
+/*
+ *	note_login()
+ *	Purpose: reduce one login into the user table, keeping the latest
+ *	 Method: Hash the name (FNV-1a) to a chain, and lock the chain's stripe
+ *			 while it is searched and updated. Nodes are only added, never
+ *			 removed, until the scan is over.
+ */
+void note_login(struct utmp *up)
+{
+	unsigned long h = 14695981039346656037UL;
+	struct seen *sp;
+	int i;
+
+	for (i = 0; i < UT_NAMESIZE && up->ut_user[i] != '\0'; i++)
+		h = (h ^ (unsigned char) up->ut_user[i]) * 1099511628211UL;
+	h &= NBUCKETS - 1;
+
+	pthread_mutex_lock(&stripes[h % NSTRIPES]);
+
+	for (sp = buckets[h]; sp != NULL; sp = sp->next)
+		if (strncmp(sp->name, up->ut_user, UT_NAMESIZE) == 0)
+			break;
+
+	if (sp == NULL)
+	{
+		if ( (sp = calloc(1, sizeof(struct seen))) == NULL )
+		{
+			perror("alastlog");
+			exit(1);
+		}
+		memcpy(sp->name, up->ut_user, UT_NAMESIZE);
+		sp->next = buckets[h];
+		buckets[h] = sp;
+	}
+
+	if (sp->ll.ll_time < up->ut_tv.tv_sec)
+	{
+		sp->ll.ll_time = up->ut_tv.tv_sec;
+		memcpy(sp->ll.ll_line, up->ut_line, UT_LINESIZE);
+		memcpy(sp->ll.ll_host, up->ut_host, UT_HOSTSIZE);
+	}
+
+	pthread_mutex_unlock(&stripes[h % NSTRIPES]);
+}
+
+/*
+ *	scan_chunks()
+ *	Purpose: thread body, scan chunks until none are left
+ *	 Return: NULL, so it can be passed to pthread_create()
+ */
+void *scan_chunks(void *arg)
+{
+	struct utmp *buf = malloc(READ_RECS * sizeof(struct utmp));
+	long records = 0, logins = 0;
+
+	(void) arg;
+
+	if (buf == NULL)
+	{
+		perror("alastlog");
+		exit(1);
+	}
+
+	for (;;)
+	{
+		pthread_mutex_lock(&rb_lock);
+		int c = (rb_failed) ? -1 : next_chunk--;
+		pthread_mutex_unlock(&rb_lock);
+
+		if (c < 0)
+			break;
+
+		struct chunk *cp = &chunks[c];
+		off_t r;
+
+		for (r = 0; r < cp->count; r += READ_RECS)
+		{
+			off_t want = (cp->count - r < READ_RECS) ? cp->count - r
+													 : READ_RECS;
+			ssize_t amt = pread(rb_fds[cp->file], buf,
+								want * sizeof(struct utmp),
+								(cp->first + r) * sizeof(struct utmp));
+			int i;
+
+			if (amt != (ssize_t) (want * sizeof(struct utmp)))
+			{
+				perror(rb_files[cp->file]);
+				rb_failed = 1;
+				break;
+			}
+
+			for (i = 0; i < want; i++)
+				if (buf[i].ut_type == USER_PROCESS && buf[i].ut_user[0])
+				{
+					note_login(&buf[i]);
+					logins++;
+				}
+			records += want;
+		}
+	}
+
+	pthread_mutex_lock(&rb_lock);
+	stats.records += records;
+	stats.logins += logins;
+	pthread_mutex_unlock(&rb_lock);
+
+	free(buf);
+	return NULL;
+}
+
+/*
+ *	write_lastlog()
+ *	Purpose: write the users' latest logins as a new lastlog
+ *	  Input: dst, the lastlog file to replace
+ *			 lookup, resolves a user name, as getpwnam()
+ *	 Return: 0 on success, -1 on error (a message is printed to stderr)
+ *	 Method: Resolve each name, sort by UID (keeping the latest login if
+ *			 two names share one), and store the records in DST.rebuild
+ *			 with ll_write_recs(), which leaves the gaps between UIDs as
+ *			 holes. The file gets the old one's owner and mode and is then
+ *			 renamed over dst, so a failed run leaves the old lastlog.
+ */
+int write_lastlog(char *dst, struct passwd *(*lookup)(char *))
+{
+	char tmp[PATH_MAX];
+	struct seen **all;
+	struct lastlog **lls;
+	struct passwd *pw;
+	struct stat st;
+	int *recs;
+	int n = 0, i, k = 0, fd, rv = 0;
+
+	for (i = 0; i < NBUCKETS; i++)
+	{
+		struct seen *sp;
+
+		for (sp = buckets[i]; sp != NULL; sp = sp->next)
+			n++;
+	}
+
+	all = malloc((n + 1) * sizeof(struct seen *));
+	lls = malloc((n + 1) * sizeof(struct lastlog *));
+	recs = malloc((n + 1) * sizeof(int));
+	if (all == NULL || lls == NULL || recs == NULL)
+	{
+		perror("alastlog");
+		exit(1);
+	}
+
+	stats.users = n;
+	n = 0;
+	for (i = 0; i < NBUCKETS; i++)
+	{
+		struct seen *sp;
+
+		for (sp = buckets[i]; sp != NULL; sp = sp->next)
+		{
+			if ( (pw = lookup(sp->name)) == NULL || pw->pw_uid > INT_MAX )
+			{
+				stats.unknown++;
+				continue;
+			}
+			sp->uid = pw->pw_uid;
+			all[n++] = sp;
+		}
+	}
+
+	qsort(all, n, sizeof(struct seen *), cmp_seen);
+
+	for (i = 0; i < n; i++)					//latest of each UID
+		if (i + 1 == n || all[i + 1]->uid != all[i]->uid)
+		{
+			recs[k] = all[i]->uid;
+			lls[k++] = &all[i]->ll;
+		}
+
+	snprintf(tmp, PATH_MAX, "%s%s", dst, TMP_EXT);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd != -1 && stat(dst, &st) == 0)	//keep the old file's owner, mode
+	{
+		if (fchown(fd, st.st_uid, st.st_gid) == -1 && errno != EPERM)
+			rv = -1;						//EPERM: not root, keep ours
+		fchmod(fd, st.st_mode & 07777);
+	}
+
+	if (fd == -1 || rv == -1 || ll_write_recs(fd, recs, lls, k) == -1 ||
+		fsync(fd) == -1)
+		rv = -1;
+	if (fd != -1 && close(fd) == -1)
+		rv = -1;
+	if (rv == 0 && rename(tmp, dst) == -1)
+		rv = -1;
+
+	if (rv == -1)
+	{
+		perror(dst);
+		if (fd != -1)
+			unlink(tmp);
+	}
+	else
+		stats.written = k;
+
+	free(all);
+	free(lls);
+	free(recs);
+
+	return rv;
+}
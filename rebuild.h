@@ -0,0 +1,7 @@
+/*
+ * rebuild.h - header file with functions located in rebuild.c
+ */
+
+#include <pwd.h>
+
+int rebuild_file(char **, int, char *, struct passwd *(*)(char *), int);
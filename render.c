@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lllib.h"
+#include "mem.h"
+#include "render.h"
+#include "prof.h"
+
+#define JSON_MAX		(6 * (UT_LINESIZE + UT_HOSTSIZE) + 96)	//an NDJSON
+									//row, less 6 bytes per name char
+#define NUM_RECENT		5			//summary's "logged in within" counts
+#define NO 				0
+#define YES 			1
+
+/*
+ * summary - the totals a SINK_SUMMARY sink writes, added up per chunk
+ */
+struct summary {
+	long users;						//rows rendered
+	long logged_in;					//of those, with a login
+	long recent[NUM_RECENT];		//logins within recent_days[i] days
+	time_t latest;					//latest login, 0 if none
+	char latest_user[ROW_MAX];		//whose it was, cut to fit
+};
+
+/*
+ * chunk - a run of rows formatted by one thread into its own buffers, one
+ * per format some sink wants, and its part of the summary
+ */
+struct chunk {
+	struct row *rows;				//first row of the run
+	int n;							//rows in the run
+	char *buf[SINK_FORMATS];		//formatted text; SINK_TEXT is ROW_MAX
+									//bytes per row, SINK_NDJSON grows
+	size_t cap[SINK_FORMATS];		//bytes allocated for buf
+	size_t len[SINK_FORMATS];		//bytes of text in buf
+	struct summary sum;				//if a SINK_SUMMARY sink is attached
+};
+
+/*
+ * sink - one output: a format and where it goes
+ */
+struct sink {
+	int format;						//SINK_TEXT, SINK_NDJSON or SINK_SUMMARY
+	int fd;							//STDOUT_FILENO, a file we opened, or -1
+									//until render_init() opens it
+	char *path;						//for messages, "stdout" for stdout
+	int headers;					//have headers been written here
+	int failed;						//a write failed, errno kept in err
+	int err;
+};
+
+static int nthreads = 1;			//threads formatting a batch
+static struct sink sinks[MAX_SINKS];	//render_sink(), or text to stdout
+static int num_sinks;
+static int wanted[SINK_FORMATS];	//some sink takes this format
+static struct summary total;		//every batch's summary, added up
+static int paused = NO;				//render_pause(): format, write nothing
+static time_t now;					//for the summary's recent counts
+static const int recent_days[NUM_RECENT] = { 1, 7, 30, 90, 365 };
+static const char *formats[SINK_FORMATS] = { "text", "ndjson", "summary" };
+static struct chunk chunks[MAX_THREADS];	//one per thread, reused
+static pthread_once_t tz_once = PTHREAD_ONCE_INIT;	//tzset() done
+
+void add_summary(struct summary *, const struct summary *);
+void count_row(struct summary *, const struct row *);
+void *format_chunk(void *);
+int format_field(char *, struct ll_field, int);
+int format_json(char *, const struct row *);
+int format_jstr(char *, const char *, int);
+int format_summary(char *, const struct summary *);
+void sink_write(struct sink *, const char *, size_t);
+
+/*
+ *	render_init()
+ *	Purpose: set the number of threads used to format each batch of rows,
+ *			 and create or truncate the sinks' files
+ *	  Input: threads, 1 to format in the calling thread only
+ *	 Return: 0 on success, -1 if a sink's file cannot be opened (errno is
+ *			 set, and the file's path is printed to stderr)
+ *	   Note: Files are opened here, not in render_sink(), so a run that
+ *			 fails its checks first leaves them as they were. A file is
+ *			 only opened once, however often this is called.
+ */
+int render_init(int threads)
+{
+	int i;
+
+	if (threads < 1)
+		threads = 1;
+	else if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	nthreads = threads;
+	now = time(NULL);
+
+	if (num_sinks == 0)								//the usual report
+		render_sink("text");
+
+	for (i = 0; i < num_sinks; i++)
+	{
+		struct sink *sp = &sinks[i];
+
+		if (sp->fd == -1 &&
+			(sp->fd = open(sp->path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		{
+			perror(sp->path);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *	render_pause()
+ *	Purpose: stop or restart sending rendered rows to the sinks
+ *	  Input: on, nonzero to stop: rows are still formatted, as for timing
+ *			 runs, but no sink is written to, no headers are marked as
+ *			 written, and nothing is added to the summary
+ */
+void render_pause(int on)
+{
+	paused = on;
+}
+
+/*
+ *	render_row_bytes()
+ *	Purpose: the formatting buffer space render_rows() needs per row
+ *	 Return: bytes, for the formats the attached sinks take; NDJSON rows
+ *			 are counted twice over, as their buffers grow by doubling
+ *	   Note: Call after render_init(), so the default sink is counted.
+ */
+size_t render_row_bytes()
+{
+	return (wanted[SINK_TEXT] ? ROW_MAX : 0) +
+		   (wanted[SINK_NDJSON] ? 2 * JSON_MAX : 0);
+}
+
+/*
+ *	render_sink()
+ *	Purpose: attach an output to every following render_rows()
+ *	  Input: spec, "FORMAT" or "FORMAT:PATH"; FORMAT is text (the usual
+ *			 report), ndjson (one JSON object per row) or summary (one JSON
+ *			 object of totals, written by render_finish()); PATH is a file
+ *			 for render_init() to create or truncate, stdout if missing
+ *			 or "-"
+ *	 Return: 0 on success, -1 on error (errno is EINVAL, for an unknown
+ *			 format or more than MAX_SINKS sinks)
+ *	   Note: Without a render_sink() call before render_init(), the text
+ *			 report goes to stdout.
+ */
+int render_sink(char *spec)
+{
+	struct sink *sp = &sinks[num_sinks];
+	char *path = strchr(spec, ':');
+	size_t flen = path ? (size_t) (path - spec) : strlen(spec);
+	int f;
+
+	for (f = 0; f < SINK_FORMATS; f++)
+		if (strlen(formats[f]) == flen && strncmp(spec, formats[f], flen) == 0)
+			break;
+
+	if (f == SINK_FORMATS || num_sinks == MAX_SINKS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	sp->format = f;
+	if (path == NULL || strcmp(path + 1, "-") == 0)
+	{
+		sp->path = "stdout";
+		sp->fd = STDOUT_FILENO;
+	}
+	else
+	{
+		sp->path = path + 1;
+		sp->fd = -1;							//render_init() opens it
+	}
+
+	wanted[f] = YES;
+	num_sinks++;
+
+	return 0;
+}
+
+/*
+ *	render_finish()
+ *	Purpose: write the summaries and close the sinks' files
+ *	 Return: 0 on success, -1 if a write to some sink failed (errno is
+ *			 set, and the sink's path is printed to stderr)
+ */
+int render_finish()
+{
+	char buf[ROW_MAX * 8];
+	int i, rv = 0;
+
+	for (i = 0; i < num_sinks; i++)
+	{
+		struct sink *sp = &sinks[i];
+
+		if (sp->fd == -1)						//render_init() never ran
+			continue;
+
+		if (sp->format == SINK_SUMMARY)
+			sink_write(sp, buf, format_summary(buf, &total));
+
+		if (sp->fd != STDOUT_FILENO && close(sp->fd) == -1 && !sp->failed)
+		{
+			sp->failed = YES;
+			sp->err = errno;
+		}
+
+		if (sp->failed)
+		{
+			errno = sp->err;
+			perror(sp->path);
+			rv = -1;
+		}
+	}
+
+	num_sinks = 0;
+	return rv;
+}
+
+/*
+ *	render_rows()
+ *	Purpose: format a batch of rows and write them to each sink, in order
+ *	  Input: rows, the batch, already filtered by the caller
+ *			 n, number of rows in the batch
+ *	 Output: headers before the first row ever written, then one line per
+ *			 row, byte-for-byte what printing each row in turn would give
+ *	 Method: Split the batch into nthreads contiguous chunks. Chunk 0 is
+ *			 formatted by the calling thread while a worker thread formats
+ *			 each of the others into its own buffers, once per format
+ *			 that some sink takes. After all are joined, each sink is given
+ *			 the buffers of its format in chunk order, so output order never
+ *			 depends on which thread finished first. The scan and the name
+ *			 lookups behind the batch are shared by all the sinks.
+ *	   Note: If a worker cannot be started, the calling thread formats that
+ *			 chunk itself after the others are joined.
+ */
+void render_rows(struct row *rows, int n)
+{
+	pthread_t tids[MAX_THREADS];
+	int started[MAX_THREADS];
+	int per = (n + nthreads - 1) / nthreads;
+	int i, k, used = 0;
+
+	if (n <= 0)
+		return;
+
+	prof_enter("render_rows");
+
+	for (i = 0; i < nthreads && used < n; i++)		//carve up the batch
+	{
+		struct chunk *cp = &chunks[i];
+
+		cp->rows = rows + used;
+		cp->n = (n - used < per) ? n - used : per;
+		used += cp->n;
+
+		if (wanted[SINK_TEXT] && cp->cap[SINK_TEXT] < (size_t) cp->n * ROW_MAX)
+		{											//grow, never shrink
+			mem_free(cp->buf[SINK_TEXT]);
+			cp->cap[SINK_TEXT] = (size_t) cp->n * ROW_MAX;
+			if ( (cp->buf[SINK_TEXT] = mem_alloc(cp->cap[SINK_TEXT])) == NULL )
+			{
+				perror("alastlog");
+				exit(1);
+			}
+		}
+
+		started[i] = (i > 0 &&
+					  pthread_create(&tids[i], NULL, format_chunk, cp) == 0);
+	}
+
+	int count = i;
+
+	for (i = 0; i < count; i++)						//join, or do it here
+	{
+		if (started[i])
+			pthread_join(tids[i], NULL);
+		else
+			format_chunk(&chunks[i]);
+	}
+
+	for (k = 0; k < num_sinks; k++)
+	{
+		struct sink *sp = &sinks[k];
+
+		if (sp->format == SINK_SUMMARY || paused)
+			continue;
+
+		if (sp->format == SINK_TEXT && sp->headers == NO)	//first rows
+		{
+			char head[ROW_MAX];
+			sink_write(sp, head, format_headers(head));
+			sp->headers = YES;
+		}
+
+		for (i = 0; i < count; i++)
+			sink_write(sp, chunks[i].buf[sp->format],
+					   chunks[i].len[sp->format]);
+	}
+
+	for (i = 0; wanted[SINK_SUMMARY] && !paused && i < count; i++)
+		add_summary(&total, &chunks[i].sum);
+
+	prof_exit();
+}
+
+/*
+ *	add_summary() - add a chunk's summary into a running total
+ */
+void add_summary(struct summary *to, const struct summary *from)
+{
+	int i;
+
+	to->users += from->users;
+	to->logged_in += from->logged_in;
+	for (i = 0; i < NUM_RECENT; i++)
+		to->recent[i] += from->recent[i];
+
+	if (from->latest > to->latest)
+	{
+		to->latest = from->latest;
+		strcpy(to->latest_user, from->latest_user);
+	}
+}
+
+/*
+ *	count_row() - add one row to a summary
+ */
+void count_row(struct summary *sp, const struct row *rp)
+{
+	time_t t = rp->found ? rp->ll.ll_time : 0;
+	int i;
+
+	sp->users++;
+	if (t == 0)
+		return;
+
+	sp->logged_in++;
+	for (i = 0; i < NUM_RECENT; i++)
+		sp->recent[i] += (difftime(now, t) <= recent_days[i] * 86400.0);
+
+	if (t > sp->latest)
+	{
+		sp->latest = t;
+		snprintf(sp->latest_user, ROW_MAX, "%s", rp->name);
+	}
+}
+
+/*
+ *	format_chunk()
+ *	Purpose: thread body, format every row of a chunk into its buffer
+ *	  Input: arg, pointer to the struct chunk
+ *	 Return: NULL, so it can be passed to pthread_create()
+ *	   Note: Uses no profiler spans; the span stack belongs to the main
+ *			 thread, and samples taken here are charged to render_rows.
+ */
+void *format_chunk(void *arg)
+{
+	struct chunk *cp = arg;
+	int i;
+
+	cp->len[SINK_TEXT] = 0;
+	for (i = 0; wanted[SINK_TEXT] && i < cp->n; i++)
+		cp->len[SINK_TEXT] += format_row(cp->buf[SINK_TEXT] +
+										 cp->len[SINK_TEXT], &cp->rows[i]);
+
+	cp->len[SINK_NDJSON] = 0;
+	for (i = 0; wanted[SINK_NDJSON] && i < cp->n; i++)
+	{
+		size_t need = cp->len[SINK_NDJSON] + JSON_MAX +
+					  6 * strlen(cp->rows[i].name);
+
+		if (need > cp->cap[SINK_NDJSON])		//grow, never shrink
+		{
+			size_t want = 2 * need;				//or just need, near the limit
+			char *bigger = mem_realloc(cp->buf[SINK_NDJSON], want);
+
+			if (bigger == NULL &&
+				(bigger = mem_realloc(cp->buf[SINK_NDJSON], want = need)) == NULL)
+			{
+				perror("alastlog");
+				exit(1);
+			}
+			cp->buf[SINK_NDJSON] = bigger;
+			cp->cap[SINK_NDJSON] = want;
+		}
+
+		cp->len[SINK_NDJSON] += format_json(cp->buf[SINK_NDJSON] +
+											cp->len[SINK_NDJSON], &cp->rows[i]);
+	}
+
+	memset(&cp->sum, 0, sizeof(cp->sum));
+	for (i = 0; wanted[SINK_SUMMARY] && i < cp->n; i++)
+		count_row(&cp->sum, &cp->rows[i]);
+
+	return NULL;
+}
+
+/*
+ *	format_field()
+ *	Purpose: format a field view left-justified in a column, plus a space
+ *	  Input: buf, where to write the text
+ *			 f, the field view, from ll_field()
+ *			 width, column width; longer text is cut to fit, as "%-8.8s"
+ *	 Return: number of chars written, not counting the '\0'
+ */
+int format_field(char *buf, struct ll_field f, int width)
+{
+	return sprintf(buf, "%-*.*s ", width, f.len < width ? f.len : width,
+				   f.str);
+}
+
+/*
+ *	format_json()
+ *	Purpose: format one row as an NDJSON line into buf (at least JSON_MAX
+ *			 bytes plus 6 per char of the name)
+ *	 Return: number of chars written, not counting the '\0'
+ *	 Output: {"user":..,"uid":..,"time":..,"line":..,"host":..}, time in
+ *			 epoch seconds, 0 (and empty line and host) if never logged in
+ */
+int format_json(char *buf, const struct row *rp)
+{
+	struct ll_field line = ll_field(rp->found ? rp->ll.ll_line : "",
+									rp->found ? UT_LINESIZE : 0);
+	struct ll_field host = ll_field(rp->found ? rp->ll.ll_host : "",
+									rp->found ? UT_HOSTSIZE : 0);
+	int len = sprintf(buf, "{\"user\":");
+
+	len += format_jstr(buf + len, rp->name, strlen(rp->name));
+	len += sprintf(buf + len, ",\"uid\":%u,\"time\":%ld,\"line\":",
+				   (unsigned) rp->uid, rp->found ? (long) rp->ll.ll_time : 0L);
+	len += format_jstr(buf + len, line.str, line.len);
+	len += sprintf(buf + len, ",\"host\":");
+	len += format_jstr(buf + len, host.str, host.len);
+	len += sprintf(buf + len, "}\n");
+
+	return len;
+}
+
+/*
+ *	format_jstr()
+ *	Purpose: format len bytes of s as a quoted JSON string into buf
+ *	 Return: number of chars written, at most 6 * len + 2
+ *	   Note: '"', '\\' and control chars are escaped; other bytes are
+ *			 copied as they are, as lastlog does not say what encoding
+ *			 its fields are in.
+ */
+int format_jstr(char *buf, const char *s, int len)
+{
+	int i, out = 0;
+
+	buf[out++] = '"';
+	for (i = 0; i < len; i++)
+	{
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\')
+		{
+			buf[out++] = '\\';
+			buf[out++] = c;
+		}
+		else if (c < 0x20)
+			out += sprintf(buf + out, "\\u%04x", c);
+		else
+			buf[out++] = c;
+	}
+	buf[out++] = '"';
+	buf[out] = '\0';
+
+	return out;
+}
+
+/*
+ *	format_headers() - format the lastlog headers into buf
+ *	 Return: number of chars written, not counting the '\0'
+ */
+int format_headers(char *buf)
+{
+	return sprintf(buf, "%-16.16s %-8.8s %-16.16s %s\n",
+				   "Username", "Port", "From", "Latest");
+}
+
+/*
+ *	format_row()
+ *	Purpose: format one row into buf (at least ROW_MAX bytes)
+ *	  Input: buf, where to write the text
+ *			 rp, the row, with name and lastlog record
+ *	 Return: number of chars written, not counting the '\0'
+ *	 Output: fixed-width formatted columns for username, line, host, and time
+ *	   Note: For rows without a record (found is 0), blank strings are used
+ *			 for line and host, as there is no struct to take them from.
+ *			 Line and host are read through ll_field() views, so the row is
+ *			 left untouched.
+ */
+int format_row(char *buf, const struct row *rp)
+{
+	int len = sprintf(buf, "%-16.16s ", rp->name);		//username
+
+	if (rp->found)										//record exists
+	{
+		len += format_field(buf + len,
+							ll_field(rp->ll.ll_line, UT_LINESIZE), 8);
+		len += format_field(buf + len,
+							ll_field(rp->ll.ll_host, UT_HOSTSIZE), 16);
+	}
+	else												//print blanks
+		len += sprintf(buf + len, "%-8.8s %-16.16s ", "", "");
+
+	len += format_time(buf + len, rp->found ? &rp->ll : NULL, TIME_FORMAT);
+	buf[len++] = '\n';									//end of record
+	buf[len] = '\0';
+
+	return len;
+}
+
+/*
+ *	format_summary()
+ *	Purpose: format the totals as one JSON line into buf (ROW_MAX * 8 bytes)
+ *	 Return: number of chars written, not counting the '\0'
+ */
+int format_summary(char *buf, const struct summary *sp)
+{
+	int len = sprintf(buf, "{\"users\":%ld,\"logged_in\":%ld,\"never\":%ld",
+					  sp->users, sp->logged_in, sp->users - sp->logged_in);
+	int i;
+
+	for (i = 0; i < NUM_RECENT; i++)
+		len += sprintf(buf + len, ",\"within_%dd\":%ld", recent_days[i],
+					   sp->recent[i]);
+
+	len += sprintf(buf + len, ",\"latest_time\":%ld,\"latest_user\":",
+				   (long) sp->latest);
+	len += format_jstr(buf + len, sp->latest_user, strlen(sp->latest_user));
+	len += sprintf(buf + len, "}\n");
+
+	return len;
+}
+
+/*
+ *	format_time()
+ *	Purpose: format a login time into buf
+ *	  Input: buf, where to write the text (at least TIMESIZE bytes)
+ *			 lp, pointer to the lastlog record
+ *			 fmt, the format to print the time in
+ *	 Return: number of chars written, not counting the '\0'
+ *	 Output: If the lastlog record is null, or the time is 0, the user
+ *			 does not exist or has never logged on, so say that. Otherwise,
+ *			 get the time, lp->ll_time, and format it according to "fmt".
+ *	  Notes: copied, with slight modifications, from the who2.c code from
+ *			 lecture #2. localtime_r() rather than localtime(), as worker
+ *			 threads call this at the same time. localtime_r() need not
+ *			 read TZ, so tzset() is called once, by whichever thread gets
+ *			 here first; runs that never show a time never load the zone.
+ */
+int format_time(char *buf, const struct lastlog *lp, char *fmt)
+{
+	if (lp == NULL || lp->ll_time == 0)		//user doesn't exist/no login
+		return sprintf(buf, "%s", "**Never logged in**");
+
+	struct tm tm;
+	time_t time = lp->ll_time;
+
+	pthread_once(&tz_once, tzset);
+
+	localtime_r(&time, &tm);
+	return strftime(buf, TIMESIZE, fmt, &tm);
+}
+
+/*
+ *	sink_write()
+ *	Purpose: write text to one sink, noting the first error
+ */
+void sink_write(struct sink *sp, const char *buf, size_t len)
+{
+	if (!sp->failed && write_fd(sp->fd, buf, len) == -1)
+	{
+		sp->failed = YES;
+		sp->err = errno;
+	}
+}
+
+/*
+ *	write_all()
+ *	Purpose: write text to standard output with write(), not stdio
+ *	  Input: buf, the text
+ *			 len, its length
+ *	 Return: 0 on success, -1 on a write error
+ *	   Note: Output is always built in whole buffers here, so stdio's own
+ *			 buffering would only add a copy, and a single-row -u run never
+ *			 has to set up stdout at all.
+ */
+int write_all(const char *buf, size_t len)
+{
+	return write_fd(STDOUT_FILENO, buf, len);
+}
+
+/*
+ *	write_fd() - write_all() to any descriptor
+ */
+int write_fd(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t amt = write(fd, buf, len);
+
+		if (amt == -1)
+			return -1;
+
+		buf += amt;
+		len -= amt;
+	}
+
+	return 0;
+}
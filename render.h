@@ -0,0 +1,39 @@
+/*
+ * render.h - header file with functions located in render.c
+ */
+
+#include <lastlog.h>
+#include <sys/types.h>
+
+#define MAX_THREADS	64				//most rendering threads allowed
+#define ROW_MAX		128				//longest formatted row, with newline
+#define TIME_FORMAT	"%a %b %e %H:%M:%S %z %Y"
+#define TIMESIZE	32				//room for a formatted time
+#define MAX_SINKS	8				//most render_sink() outputs
+#define SINK_TEXT		0			//the usual report
+#define SINK_NDJSON		1			//one JSON object per row
+#define SINK_SUMMARY	2			//one JSON object of totals, at the end
+#define SINK_FORMATS	3
+
+/*
+ * row - one passwd entry and its lastlog record, copied out of lllib's
+ * buffer so a batch of rows can be formatted after the buffer has moved on
+ */
+struct row {
+	char *name;						//username, strdup()ed by the caller
+	uid_t uid;						//UID, the index into lastlog
+	int found;						//0 if ll_seek()/ll_read() failed
+	struct lastlog ll;				//the record, valid if found
+};
+
+int format_headers(char *);
+int format_row(char *, const struct row *);
+int format_time(char *, const struct lastlog *, char *);
+int render_init(int);
+void render_pause(int);
+int render_sink(char *);
+int render_finish();
+void render_rows(struct row *, int);
+size_t render_row_bytes();
+int write_all(const char *, size_t);
+int write_fd(int, const char *, size_t);
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "render.h"
+#include "tenant.h"
+
+#define TN_LINE			1024		//longest mapping line
+
+/*
+ * tn_range - one line of the mapping file, while it is being loaded
+ */
+struct tn_range {
+	uid_t lo;						//first UID
+	uid_t hi;						//last UID
+	char *name;						//tenant, then NULL once numbered
+	int tenant;						//index into tenants
+};
+
+/*
+ * tn_span - the rest of an indexed range, next to its lo_key
+ */
+struct tn_span {
+	uid_t hi;						//last UID
+	int tenant;						//index into tenants
+};
+
+/*
+ * tenant - one tenant's totals
+ */
+struct tenant {
+	char *name;
+	long users;						//passwd entries in its ranges
+	long active;					//of those, with a login that is shown
+	time_t latest;					//latest such login, 0 if none
+	uid_t latest_uid;				//whose it was
+};
+
+static struct tn_range *ranges;		//as loaded, then sorted by lo
+static int num_ranges;
+static uid_t *lo_key;				//first UID of each range, ascending
+static struct tn_span *spans;		//spans[i] goes with lo_key[i]
+static struct tenant *tenants;		//in name order
+static int num_tenants;
+static struct tenant unmapped = { "(unmapped)", 0, 0, 0, 0 };
+
+static int cmp_lo(const void *, const void *);
+static int cmp_name(const void *, const void *);
+static int tn_index();
+
+/*
+ *	tn_load()
+ *	Purpose: read a tenant map and build the UID index
+ *	  Input: path, lines of "LO-HI TENANT" or "UID TENANT"
+ *	 Return: number of ranges, or -1 on error (errno is set, EINVAL for a
+ *			 line that is not a range or ranges that overlap)
+ *	   Note: Blank lines and lines starting with '#' are skipped. A tenant
+ *			 may own any number of ranges.
+ */
+int tn_load(char *path)
+{
+	char line[TN_LINE], name[TN_LINE];
+	FILE *fp = fopen(path, "r");
+	unsigned long lo, hi;
+	int cap = 0, n;
+
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, TN_LINE, fp) != NULL)
+	{
+		char *p = line + strspn(line, " \t");
+
+		if (*p == '\0' || *p == '\n' || *p == '#')
+			continue;
+
+		if ( (n = sscanf(p, "%lu-%lu %1023s", &lo, &hi, name)) != 3 &&
+			 (n = sscanf(p, "%lu %1023s", &lo, name)) == 2 )
+		{
+			hi = lo;							//one UID, checked below
+			n = 3;
+		}
+		if (n != 3 || hi < lo || hi > (uid_t) -1)
+		{
+			fclose(fp);
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (num_ranges == cap)
+		{
+			struct tn_range *bigger = mem_realloc(ranges, (2 * cap + 64) *
+												  sizeof(struct tn_range));
+			if (bigger == NULL)
+			{
+				fclose(fp);
+				return -1;
+			}
+			ranges = bigger;
+			cap = 2 * cap + 64;
+		}
+
+		ranges[num_ranges].lo = lo;
+		ranges[num_ranges].hi = hi;
+		if ( (ranges[num_ranges].name = strdup(name)) == NULL )
+		{
+			fclose(fp);
+			return -1;
+		}
+		num_ranges++;
+	}
+
+	fclose(fp);
+
+	return (tn_index() == -1) ? -1 : num_ranges;
+}
+
+/*
+ *	tn_find()
+ *	Purpose: find the tenant that owns a UID
+ *	 Return: the tenant's index, or -1 if no range holds the UID
+ *	 Method: Binary search over lo_key for the last range starting at or
+ *			 below uid, without branches in the loop, so the compares do
+ *			 not stall on mispredictions; the keys are packed together, so
+ *			 a few thousand ranges stay in a few cache lines per level. The
+ *			 matching span then says if uid is inside it.
+ */
+int tn_find(uid_t uid)
+{
+	const uid_t *base = lo_key;
+	int n = num_ranges;
+
+	if (n == 0 || uid < lo_key[0])
+		return -1;
+
+	while (n > 1)
+	{
+		int half = n / 2;
+
+		base = (base[half] <= uid) ? base + half : base;
+		n -= half;
+	}
+
+	return (uid <= spans[base - lo_key].hi) ? spans[base - lo_key].tenant
+											: -1;
+}
+
+/*
+ *	tn_add()
+ *	Purpose: count one passwd entry toward its tenant
+ *	  Input: tenant, from tn_find(), -1 for UIDs in no range
+ *			 uid, the entry's UID
+ *			 lp, its lastlog record, NULL if there is none
+ *			 shown, nonzero if the row passes the report's filters
+ */
+void tn_add(int tenant, uid_t uid, const struct lastlog *lp, int shown)
+{
+	struct tenant *tp = (tenant < 0) ? &unmapped : &tenants[tenant];
+
+	tp->users++;
+	if (!shown || lp == NULL || lp->ll_time == 0)
+		return;
+
+	tp->active++;
+	if (lp->ll_time > tp->latest)
+	{
+		tp->latest = lp->ll_time;
+		tp->latest_uid = uid;
+	}
+}
+
+/*
+ *	tn_report()
+ *	Purpose: print each tenant's totals
+ *	  Input: lookup, gives the name of the latest user, as getpwuid()
+ *	 Output: one line per tenant, in name order, then one for the UIDs in
+ *			 no range if there were any
+ *	   Note: Names are looked up here, once per tenant, not per row.
+ */
+void tn_report(struct passwd *(*lookup)(uid_t))
+{
+	char when[TIMESIZE];
+	int i;
+
+	printf("%-16.16s %8s %8s %-16.16s %s\n", "Tenant", "Users", "Active",
+		   "Latest user", "Latest");
+
+	for (i = 0; i <= num_tenants; i++)
+	{
+		struct tenant *tp = (i < num_tenants) ? &tenants[i] : &unmapped;
+		struct lastlog ll;
+		struct passwd *pw;
+		char uid[16] = "";
+		char *who = uid;				//the UID, if it has no name
+
+		if (i == num_tenants && tp->users == 0)
+			break;
+
+		memset(&ll, 0, sizeof(ll));
+		ll.ll_time = tp->latest;
+		format_time(when, &ll, TIME_FORMAT);
+
+		if (tp->latest != 0 && (pw = lookup(tp->latest_uid)) != NULL)
+			who = pw->pw_name;
+		else if (tp->latest != 0)
+			snprintf(uid, sizeof(uid), "%u", (unsigned) tp->latest_uid);
+
+		printf("%-16.16s %8ld %8ld %-16.16s %s\n", tp->name, tp->users,
+			   tp->active, who, when);
+	}
+}
+
+/*
+ *	cmp_lo() - qsort() comparison for ranges, by first UID
+ */
+static int cmp_lo(const void *a, const void *b)
+{
+	uid_t x = ((const struct tn_range *) a)->lo;
+	uid_t y = ((const struct tn_range *) b)->lo;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	cmp_name() - qsort() comparison for ranges, by tenant name
+ */
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp(((const struct tn_range *) a)->name,
+				  ((const struct tn_range *) b)->name);
+}
+
+/*
+ *	tn_index()
+ *	Purpose: number the tenants and lay the ranges out for tn_find()
+ *	 Return: 0 on success, -1 on error (errno is set)
+ *	 Method: Sorting by name gives each distinct name its index, so the
+ *			 report comes out in name order; sorting by lo then builds the
+ *			 flat lo_key and spans arrays and finds overlaps, which would
+ *			 make a UID's tenant depend on the search.
+ */
+static int tn_index()
+{
+	int i;
+
+	qsort(ranges, num_ranges, sizeof(struct tn_range), cmp_name);
+
+	tenants = mem_calloc(num_ranges + 1, sizeof(struct tenant));
+	lo_key = mem_alloc((num_ranges + 1) * sizeof(uid_t));
+	spans = mem_alloc((num_ranges + 1) * sizeof(struct tn_span));
+	if (tenants == NULL || lo_key == NULL || spans == NULL)
+		return -1;
+
+	for (i = 0; i < num_ranges; i++)
+	{
+		if (i == 0 || strcmp(ranges[i].name, tenants[num_tenants - 1].name))
+			tenants[num_tenants++].name = ranges[i].name;	//keeps the copy
+		else
+			free(ranges[i].name);
+		ranges[i].name = NULL;
+		ranges[i].tenant = num_tenants - 1;
+	}
+
+	qsort(ranges, num_ranges, sizeof(struct tn_range), cmp_lo);
+
+	for (i = 0; i < num_ranges; i++)
+	{
+		if (i > 0 && ranges[i].lo <= ranges[i - 1].hi)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		lo_key[i] = ranges[i].lo;
+		spans[i].hi = ranges[i].hi;
+		spans[i].tenant = ranges[i].tenant;
+	}
+
+	mem_free(ranges);
+	ranges = NULL;
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * tenant.h - header file with functions located in tenant.c
+ */
+
+#include <lastlog.h>
+#include <pwd.h>
+#include <sys/types.h>
+
+int tn_load(char *);
+int tn_find(uid_t);
+void tn_add(int, uid_t, const struct lastlog *, int);
+void tn_report(struct passwd *(*)(uid_t));
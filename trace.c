@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define TRACE_LINE	4096			//longest line written; longer is cut
+
+static char *trace_path;			//--trace-queries file
+static int trace_ac;				//the invocation's arguments
+static char **trace_av;
+static struct timespec trace_t0;	//when trace_start() was called
+static int trace_rv = 1;			//exit status, 1 unless trace_end() is
+
+static void trace_write();			//atexit() handler
+static int trace_escape(char *, int, const char *);
+
+/*
+ *	trace_start()
+ *	Purpose: start timing this invocation for --trace-queries
+ *	  Input: path, the trace file, appended to at exit
+ *			 ac, av, main()'s arguments, recorded as they are
+ *	 Return: 0 on success, -1 if the handler cannot be installed
+ *	 Method: The line is written by an atexit() handler, so runs that end
+ *			 in exit(1) on an error are traced too, with status 1.
+ */
+int trace_start(char *path, int ac, char *av[])
+{
+	clock_gettime(CLOCK_MONOTONIC, &trace_t0);
+	trace_path = path;
+	trace_ac = ac;
+	trace_av = av;
+
+	return atexit(trace_write) == 0 ? 0 : -1;
+}
+
+/*
+ *	trace_end()
+ *	Purpose: record how the run ended, just before main() returns
+ *	  Input: rv, the value main() returns
+ */
+void trace_end(int rv)
+{
+	trace_rv = rv;
+}
+
+/*
+ *	trace_write()
+ *	Purpose: append this invocation's line to the trace file
+ *	 Output: "EPOCH\tMICROSECONDS\tSTATUS\tARG1\tARG2...\n", av[0] left
+ *			 out; tabs, newlines and backslashes in args are escaped as
+ *			 \t, \n and \\
+ *	   Note: The line goes out in one write() to a file opened O_APPEND, so
+ *			 lines from runs that end at the same time do not mix. Errors
+ *			 are ignored: tracing must not change how a run ends.
+ */
+static void trace_write()
+{
+	char line[TRACE_LINE];
+	struct timespec t1;
+	int fd, i, len;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	len = snprintf(line, TRACE_LINE, "%ld\t%ld\t%d", (long) time(NULL),
+				   (t1.tv_sec - trace_t0.tv_sec) * 1000000L +
+				   (t1.tv_nsec - trace_t0.tv_nsec) / 1000, trace_rv);
+
+	for (i = 1; i < trace_ac && len < TRACE_LINE - 1; i++)
+	{
+		line[len++] = '\t';
+		len += trace_escape(line + len, TRACE_LINE - 1 - len, trace_av[i]);
+	}
+	line[len++] = '\n';
+
+	if ( (fd = open(trace_path, O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1 )
+		return;
+	write(fd, line, len);
+	close(fd);
+}
+
+/*
+ *	trace_escape()
+ *	Purpose: copy an arg into a trace line, escaping the separators
+ *	 Return: chars stored, at most room
+ */
+static int trace_escape(char *out, int room, const char *arg)
+{
+	int len = 0;
+
+	for (; *arg != '\0'; arg++)
+	{
+		char c = *arg;
+		int esc = (c == '\t' || c == '\n' || c == '\\');
+
+		if (len + 1 + esc > room)
+			break;
+		if (esc)
+		{
+			out[len++] = '\\';
+			c = (c == '\t') ? 't' : (c == '\n') ? 'n' : '\\';
+		}
+		out[len++] = c;
+	}
+
+	return len;
+}
@@ -0,0 +1,6 @@
+/*
+ * trace.h - header file with functions located in trace.c
+ */
+
+int trace_start(char *, int, char *[]);
+void trace_end(int);